@@ -24,6 +24,13 @@ project ( _name )
         "bgfx",
     }
 
+    configuration { "linux-*" }
+        links {
+            "pthread",
+        }
+
+    configuration {}
+
     files 
     {
         CRADLE_DIR .. "src/**.h",
@@ -33,9 +40,60 @@ project ( _name )
 
     excludes
     {
-        CRADLE_DIR .. "src/foundation/unit_test.cpp"
+        CRADLE_DIR .. "src/foundation/unit_test.cpp",
+        CRADLE_DIR .. "src/tools/**.cpp"
+    }
+
+    configuration { "debug or development" }
+        flags {
+            "Symbols"
+        }
+        defines {
+            "_DEBUG",
+        }
+
+    configuration { "release" }
+        defines {
+            "NDEBUG"
+        }
+
+    configuration {}
+
+    strip()
+
+    configuration {}
+end
+
+function cradle_tool_project( _name, _main, _defines )
+project ( _name )
+    kind "ConsoleApp"
+
+    includedirs
+    {
+        CRADLE_DIR .. "src/",
+    }
+
+    defines
+    {
+        _defines
+    }
+
+    files
+    {
+        CRADLE_DIR .. "src/core/**.h",
+        CRADLE_DIR .. "src/core/**.cpp",
+        CRADLE_DIR .. "src/math/**.h",
+        CRADLE_DIR .. "src/physics/**.h",
+        CRADLE_DIR .. "src/physics/**.inl",
+        CRADLE_DIR .. "src/physics/**.cpp",
+        CRADLE_DIR .. "src/tools/" .. _main,
     }
 
+    configuration { "linux-*" }
+        links {
+            "pthread",
+        }
+
     configuration { "debug or development" }
         flags {
             "Symbols"
@@ -55,3 +55,7 @@ end
 group "cradle"
 cradle_project("cradle", "ConsoleApp", {})
 
+group "tools"
+cradle_tool_project("cradle_sim", "cradle_sim.cpp", {})
+cradle_tool_project("cradle_bench", "cradle_bench.cpp", {})
+
@@ -89,7 +89,11 @@ function toolchain(build_dir, lib_dir)
         buildoptions
         {
             -- "-m64",
-            "-std=c++11"
+            "-std=c++11",
+            -- replays must re-simulate bit-for-bit: no fused multiply-adds
+            -- and no reassociation, whatever the target or optimization
+            "-ffp-contract=off",
+            "-fno-fast-math",
         }
 
     configuration { "development or release" }
@@ -127,6 +131,7 @@ function toolchain(build_dir, lib_dir)
         buildoptions {
             "/Oy-", -- Suppresses creation of frame pointers on the call stack.
             "/Ob2", -- The Inline Function Expansion
+            "/fp:precise", -- No contraction or reassociation, replays re-simulate bit-for-bit.
         }
         linkoptions {
             "/ignore:4199", -- LNK4199: /DELAYLOAD:*.dll ignored; no imports found from *.dll
@@ -0,0 +1,99 @@
+#!/usr/bin/env python3
+#
+# Copyright (c) 2015 Jonathan Howard
+# License: https://github.com/v3n/altertum/blob/master/LICENSE
+#
+
+"""
+Compare two benchmark runs and flag regressions
+
+Reads the JSON written by cradle_bench --json, or by any Google Benchmark
+binary, matches benchmarks by name and prints how much each one changed.
+Exits with 1 if any benchmark got slower than the threshold allows.
+
+usage: compare_bench.py baseline.json contender.json [--threshold 0.05] [--metric real_time]
+"""
+
+import argparse
+import json
+import sys
+
+TIME_UNITS = { "ns": 1.0, "us": 1e3, "ms": 1e6, "s": 1e9 }
+
+
+def load(path):
+    """Benchmark times in nanoseconds by name, for both metrics."""
+    with open(path) as f:
+        data = json.load(f)
+
+    runs = {}
+    for bench in data.get("benchmarks", []):
+        # repeated runs report aggregates; compare their means only
+        if bench.get("run_type") == "aggregate" and bench.get("aggregate_name") != "mean":
+            continue
+
+        name = bench.get("run_name", bench["name"])
+        scale = TIME_UNITS.get(bench.get("time_unit", "ns"), 1.0)
+        runs[name] = {
+            "real_time": bench["real_time"] * scale,
+            "cpu_time": bench["cpu_time"] * scale,
+        }
+    return runs
+
+
+def format_time(ns):
+    for unit, scale in (("s", 1e9), ("ms", 1e6), ("us", 1e3)):
+        if ns >= scale:
+            return "%.3f %s" % (ns / scale, unit)
+    return "%.1f ns" % ns
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Compare two benchmark runs and flag regressions.")
+    parser.add_argument("baseline", help="JSON of the run to compare against")
+    parser.add_argument("contender", help="JSON of the new run")
+    parser.add_argument("--threshold", type=float, default=0.05,
+                        help="relative slowdown that counts as a regression (default 0.05)")
+    parser.add_argument("--metric", choices=("real_time", "cpu_time"), default="real_time",
+                        help="time to compare (default real_time)")
+    args = parser.parse_args()
+
+    baseline = load(args.baseline)
+    contender = load(args.contender)
+
+    names = [name for name in contender if name in baseline]
+    if not names:
+        print("compare_bench: no benchmarks in common", file=sys.stderr)
+        return 2
+
+    width = max(len(name) for name in names)
+    print("%-*s %14s %14s %9s" % (width, "benchmark", "baseline", "contender", "change"))
+
+    regressions = 0
+    for name in names:
+        old = baseline[name][args.metric]
+        new = contender[name][args.metric]
+        change = (new - old) / old if old > 0 else 0.0
+
+        flag = ""
+        if change > args.threshold:
+            flag = "  REGRESSION"
+            regressions += 1
+        elif change < -args.threshold:
+            flag = "  faster"
+
+        print("%-*s %14s %14s %+8.1f%%%s" % (width, name, format_time(old), format_time(new), 100 * change, flag))
+
+    only_baseline = len(set(baseline) - set(contender))
+    only_contender = len(set(contender) - set(baseline))
+    if only_baseline or only_contender:
+        print("not compared: %d only in baseline, %d only in contender" % (only_baseline, only_contender))
+
+    if regressions:
+        print("%d regression(s) over %.1f%%" % (regressions, 100 * args.threshold))
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
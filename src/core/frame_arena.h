@@ -0,0 +1,145 @@
+/*
+ * Copyright (c) 2015 Jonathan Howard
+ * License: https://github.com/v3n/altertum/blob/master/LICENSE
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+
+/**
+ * @file frame_arena.h
+ * Linear allocator for scratch memory that lives for one frame or one call
+ * Allocating bumps an offset into a single block, and everything is freed
+ * at once by rewinding to a mark. Requests that do not fit spill to the
+ * heap; the next time the arena is emptied the block grows to the high
+ * water mark, so a steady workload stops allocating after the first frames.
+ * Memory comes from the global operator new, so allocation hooks see it.
+ * Not thread safe, use one arena per thread.
+ */
+struct FrameArena
+{
+    /** Header of a heap block holding a request that did not fit. */
+    struct Spill
+    {
+        Spill * next;
+        size_t  bytes;
+    };
+
+    /** Position to rewind to, taken by mark(). */
+    struct Mark
+    {
+        size_t  used;
+        Spill * spill;
+    };
+
+    FrameArena()
+        : block(NULL)
+        , capacity(0)
+        , used(0)
+        , peak(0)
+        , spill(NULL)
+        , spilled(0)
+    {
+    }
+
+    ~FrameArena()
+    {
+        reset();
+        ::operator delete(block);
+    }
+
+    /** Grow the block to at least @a bytes, the arena must be empty. */
+    inline void reserve(size_t bytes)
+    {
+        if ( bytes <= capacity ) return;
+
+        ::operator delete(block);
+        block = (uint8_t *)::operator new(bytes);
+        capacity = bytes;
+    }
+
+    /** Uninitialized memory for @a bytes, aligned to @a align (a power of two). */
+    inline void* alloc(size_t bytes, size_t align = 16)
+    {
+        uintptr_t start = (uintptr_t)block + used;
+        size_t offset = (size_t)(((start + align - 1) & ~(uintptr_t)(align - 1)) - (uintptr_t)block);
+
+        if ( NULL == spill && offset + bytes <= capacity )
+        {
+            used = offset + bytes;
+            if ( used > peak ) peak = used;
+            return block + offset;
+        }
+
+        /* spill blocks form a stack so rewind() can free them in order */
+        Spill * s = (Spill *)::operator new(sizeof(Spill) + bytes + align);
+        s->next  = spill;
+        s->bytes = bytes + align;
+        spill = s;
+
+        spilled += s->bytes;
+        if ( used + spilled > peak ) peak = used + spilled;
+
+        uintptr_t aligned = ((uintptr_t)(s + 1) + align - 1) & ~(uintptr_t)(align - 1);
+        return (void *)aligned;
+    }
+
+    /** Uninitialized array of @a n @a T. */
+    template <typename T>
+    inline T* alloc_array(size_t n)
+    {
+        return (T *)alloc(n * sizeof(T), alignof(T) > 16 ? alignof(T) : 16);
+    }
+
+    inline Mark mark() const
+    {
+        Mark m = { used, spill };
+        return m;
+    }
+
+    /** Free everything allocated since @a m. */
+    inline void rewind(const Mark& m)
+    {
+        while ( spill != m.spill )
+        {
+            Spill * next = spill->next;
+            spilled -= spill->bytes;
+            ::operator delete(spill);
+            spill = next;
+        }
+        used = m.used;
+
+        if ( 0 == used && NULL == spill && peak > capacity )
+        {
+            /* ran out while full, grow once to what was needed */
+            reserve(peak);
+        }
+    }
+
+    /** Free everything. */
+    inline void reset()
+    {
+        Mark empty = { 0, NULL };
+        rewind(empty);
+    }
+
+    /** Bytes in the block, and the most ever in use at once. */
+    size_t size() const { return capacity; }
+    size_t high_water() const { return peak; }
+
+private:
+    FrameArena(const FrameArena&);
+    FrameArena& operator=(const FrameArena&);
+
+    uint8_t * block;
+    size_t    capacity;
+    size_t    used;
+    size_t    peak;
+
+    Spill *   spill;
+    size_t    spilled;
+};
@@ -0,0 +1,254 @@
+/*
+ * Copyright (c) 2015 Jonathan Howard
+ * License: https://github.com/v3n/altertum/blob/master/LICENSE
+ */
+
+#include "core/job_system.h"
+
+namespace
+{
+
+/** deque owned by the current thread, 0 for the thread that ran init() */
+thread_local size_t s_thread_index = 0;
+
+/** spins through the deques before a worker goes to sleep */
+const size_t c_spin_count = 64;
+
+/** jobs each thread can have in flight before its arena spills */
+const size_t c_arena_jobs = 256;
+
+} // namespace
+
+JobDeque::JobDeque()
+    : top(0)
+    , bottom(0)
+{
+    for ( int64_t i = 0; i < capacity; i++ )
+    {
+        buffer[i].store(NULL, std::memory_order_relaxed);
+    }
+}
+
+bool JobDeque::push(Job* job)
+{
+    int64_t b = bottom.load(std::memory_order_relaxed);
+    int64_t t = top.load(std::memory_order_acquire);
+
+    if ( b - t >= capacity ) return false;
+
+    buffer[b & (capacity - 1)].store(job, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    bottom.store(b + 1, std::memory_order_relaxed);
+
+    return true;
+}
+
+Job* JobDeque::pop()
+{
+    int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+    bottom.store(b, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t t = top.load(std::memory_order_relaxed);
+
+    if ( t > b )
+    {
+        /* empty */
+        bottom.store(b + 1, std::memory_order_relaxed);
+        return NULL;
+    }
+
+    Job* job = buffer[b & (capacity - 1)].load(std::memory_order_relaxed);
+
+    if ( t == b )
+    {
+        /* last job, race the thieves for it */
+        if ( !top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed) )
+        {
+            job = NULL;
+        }
+        bottom.store(b + 1, std::memory_order_relaxed);
+    }
+
+    return job;
+}
+
+Job* JobDeque::steal()
+{
+    int64_t t = top.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t b = bottom.load(std::memory_order_acquire);
+
+    if ( t >= b ) return NULL;
+
+    Job* job = buffer[t & (capacity - 1)].load(std::memory_order_relaxed);
+
+    if ( !top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed) )
+    {
+        return NULL;
+    }
+
+    return job;
+}
+
+void JobSystem::init(size_t _n_threads, bool _deterministic)
+{
+    shutdown();
+
+    if ( 0 == _n_threads )
+    {
+        _n_threads = std::thread::hardware_concurrency();
+    }
+    if ( 0 == _n_threads )
+    {
+        _n_threads = 1;
+    }
+
+    deterministic = _deterministic;
+    n_threads = _n_threads;
+    deques = new JobDeque[n_threads];
+    arenas = new FrameArena[n_threads];
+    for ( size_t i = 0; i < n_threads; i++ )
+    {
+        arenas[i].reserve(c_arena_jobs * sizeof(Job));
+    }
+    queued.store(0);
+    running.store(true);
+    s_thread_index = 0;
+
+    for ( size_t i = 1; i < n_threads; i++ )
+    {
+        workers.push_back(std::thread(&JobSystem::worker_main, this, i));
+    }
+}
+
+void JobSystem::shutdown()
+{
+    if ( NULL == deques ) return;
+
+    {
+        std::lock_guard<std::mutex> lock(sleep_mutex);
+        running.store(false);
+    }
+    wake.notify_all();
+
+    for ( size_t i = 0; i < workers.size(); i++ )
+    {
+        workers[i].join();
+    }
+    workers.clear();
+
+    delete[] deques;
+    deques = NULL;
+    delete[] arenas;
+    arenas = NULL;
+    n_threads = 1;
+}
+
+size_t JobSystem::this_thread_index() const
+{
+    return s_thread_index < n_threads ? s_thread_index : 0;
+}
+
+bool JobSystem::run_one(size_t index)
+{
+    Job* job = deques[index].pop();
+
+    for ( size_t i = 1; NULL == job && i < n_threads; i++ )
+    {
+        job = deques[(index + i) % n_threads].steal();
+    }
+
+    if ( NULL == job ) return false;
+
+    queued.fetch_sub(1, std::memory_order_relaxed);
+    job->function(job->data, job->begin, job->end);
+    job->remaining->fetch_sub(1, std::memory_order_release);
+
+    return true;
+}
+
+void JobSystem::worker_main(size_t index)
+{
+    s_thread_index = index;
+
+    while ( running.load(std::memory_order_relaxed) )
+    {
+        size_t spins = 0;
+        while ( run_one(index) || spins++ < c_spin_count )
+        {
+        }
+
+        std::unique_lock<std::mutex> lock(sleep_mutex);
+        while ( running.load() && 0 == queued.load() )
+        {
+            wake.wait(lock);
+        }
+    }
+}
+
+void JobSystem::parallel_for(size_t count, size_t grain, JobFunction function, void* data)
+{
+    if ( 0 == count ) return;
+    if ( 0 == grain ) grain = 1;
+
+    if ( !deterministic )
+    {
+        /* keep chunks a multiple of the requested grain */
+        size_t target = (count + n_threads * 4 - 1) / (n_threads * 4);
+        if ( target > grain ) grain = (target + grain - 1) / grain * grain;
+    }
+
+    size_t n_jobs = (count + grain - 1) / grain;
+
+    if ( NULL == deques || 1 == n_jobs )
+    {
+        for ( size_t begin = 0; begin < count; begin += grain )
+        {
+            function(data, begin, begin + grain < count ? begin + grain : count);
+        }
+        return;
+    }
+
+    size_t index = this_thread_index();
+    FrameArena::Mark mark = arenas[index].mark();
+
+    Job * jobs = arenas[index].alloc_array<Job>(n_jobs);
+    std::atomic<size_t> remaining(n_jobs);
+
+    for ( size_t i = 0; i < n_jobs; i++ )
+    {
+        Job& job = jobs[i];
+        job.function  = function;
+        job.data      = data;
+        job.begin     = i * grain;
+        job.end       = job.begin + grain < count ? job.begin + grain : count;
+        job.remaining = &remaining;
+    }
+
+    /* queue in reverse so the owner pops chunks in index order */
+    for ( size_t i = n_jobs; i-- > 0; )
+    {
+        queued.fetch_add(1, std::memory_order_relaxed);
+        if ( !deques[index].push(&jobs[i]) )
+        {
+            queued.fetch_sub(1, std::memory_order_relaxed);
+            function(data, jobs[i].begin, jobs[i].end);
+            remaining.fetch_sub(1, std::memory_order_relaxed);
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(sleep_mutex);
+    }
+    wake.notify_all();
+
+    while ( remaining.load(std::memory_order_acquire) > 0 )
+    {
+        if ( !run_one(index) )
+        {
+            std::this_thread::yield();
+        }
+    }
+
+    arenas[index].rewind(mark);
+}
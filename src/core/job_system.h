@@ -0,0 +1,126 @@
+/*
+ * Copyright (c) 2015 Jonathan Howard
+ * License: https://github.com/v3n/altertum/blob/master/LICENSE
+ */
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "core/frame_arena.h"
+
+/**
+ * @file job_system.h
+ * Work-stealing job system with one worker per core
+ * Each thread owns a Chase-Lev deque: the owner pushes and pops at the
+ * bottom, idle threads steal from the top. The thread calling parallel_for
+ * helps run its own jobs, so nested parallel_for calls cannot deadlock.
+ * parallel_for may only be called from the thread that ran init() or from
+ * inside a job. Job descriptors come from a per-thread arena, so a warm
+ * job system does not allocate.
+ */
+
+typedef void (*JobFunction)(void* data, size_t begin, size_t end);
+
+struct Job
+{
+    JobFunction           function;
+    void *                data;
+    size_t                begin;
+    size_t                end;
+    std::atomic<size_t> * remaining;
+};
+
+/** Lock-free single-owner, multi-thief deque of job pointers. */
+struct JobDeque
+{
+    static const int64_t capacity = 4096;
+
+    std::atomic<int64_t> top;
+    std::atomic<int64_t> bottom;
+    std::atomic<Job *>   buffer[capacity];
+
+    JobDeque();
+
+    /** Owner only, returns false when full. */
+    bool push(Job* job);
+    /** Owner only, newest job first. */
+    Job* pop();
+    /** Any thread, oldest job first. */
+    Job* steal();
+};
+
+struct JobSystem
+{
+    JobSystem()
+        : deterministic(false)
+        , n_threads(1)
+        , deques(NULL)
+        , arenas(NULL)
+        , queued(0)
+        , running(false)
+    {
+    }
+
+    ~JobSystem()
+    {
+        shutdown();
+    }
+
+    /**
+     * Start the job system
+     * @param n_threads total threads including the caller, 0 for one per core
+     * @param deterministic split ranges independently of the thread count
+     */
+    void init(size_t n_threads = 0, bool deterministic = false);
+    void shutdown();
+
+    /** Threads taking part in parallel_for, including the caller. */
+    size_t thread_count() const { return n_threads; }
+
+    /**
+     * Run @a function over [0, count) in chunks of at least @a grain
+     * In deterministic mode chunks are exactly @a grain long, so the split
+     * only depends on @a count. Otherwise chunks grow to keep roughly four
+     * per thread. Returns once every chunk has run.
+     */
+    void parallel_for(size_t count, size_t grain, JobFunction function, void* data);
+
+    /** parallel_for for any callable taking (begin, end). */
+    template <typename F>
+    inline void parallel_for(size_t count, size_t grain, const F& f)
+    {
+        parallel_for(count, grain, &trampoline<F>, (void*)&f);
+    }
+
+    bool deterministic;
+
+private:
+    JobSystem(const JobSystem&);
+    JobSystem& operator=(const JobSystem&);
+
+    template <typename F>
+    static void trampoline(void* data, size_t begin, size_t end)
+    {
+        (*(const F*)data)(begin, end);
+    }
+
+    void worker_main(size_t index);
+    bool run_one(size_t index);
+    size_t this_thread_index() const;
+
+    size_t                    n_threads;
+    std::vector<std::thread>  workers;
+    JobDeque *                deques;
+    FrameArena *              arenas;
+    std::atomic<size_t>       queued;
+    std::atomic<bool>         running;
+    std::mutex                sleep_mutex;
+    std::condition_variable   wake;
+};
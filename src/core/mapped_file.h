@@ -0,0 +1,115 @@
+/*
+ * Copyright (c) 2015 Jonathan Howard
+ * License: https://github.com/v3n/altertum/blob/master/LICENSE
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#if defined(_WIN32)
+#   define WIN32_LEAN_AND_MEAN
+#   include <windows.h>
+#else
+#   include <fcntl.h>
+#   include <sys/mman.h>
+#   include <sys/stat.h>
+#   include <unistd.h>
+#endif
+
+/**
+ * @file mapped_file.h
+ * Whole file mapped into memory, copy-on-write
+ * Pages are read from the file as they are first touched, and writes go
+ * to private copies of the pages, never to the file. Mapping a file is
+ * constant time whatever its size, and any number of mappings of one file
+ * share its unwritten pages.
+ */
+struct MappedFile
+{
+    uint8_t * data;
+    size_t    size;
+
+    MappedFile()
+        : data(NULL)
+        , size(0)
+    {
+    }
+
+    ~MappedFile()
+    {
+        close();
+    }
+
+    /** Map all of @a path, returns false if it cannot be opened or is empty. */
+    inline bool open(const char* path)
+    {
+        close();
+
+#if defined(_WIN32)
+        HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+        if ( INVALID_HANDLE_VALUE == file ) return false;
+
+        LARGE_INTEGER length;
+        HANDLE mapping = NULL;
+        if ( GetFileSizeEx(file, &length) && length.QuadPart > 0 )
+        {
+            mapping = CreateFileMappingA(file, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+        }
+        CloseHandle(file);
+        if ( NULL == mapping ) return false;
+
+        void * view = MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0);
+        CloseHandle(mapping);
+        if ( NULL == view ) return false;
+
+        data = (uint8_t *)view;
+        size = (size_t)length.QuadPart;
+#else
+        int fd = ::open(path, O_RDONLY);
+        if ( fd < 0 ) return false;
+
+        struct stat info;
+        void * view = MAP_FAILED;
+        if ( 0 == fstat(fd, &info) && info.st_size > 0 )
+        {
+            view = mmap(NULL, (size_t)info.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        }
+        ::close(fd);
+        if ( MAP_FAILED == view ) return false;
+
+        data = (uint8_t *)view;
+        size = (size_t)info.st_size;
+#endif
+        return true;
+    }
+
+    inline void close()
+    {
+        if ( NULL == data ) return;
+
+#if defined(_WIN32)
+        UnmapViewOfFile(data);
+#else
+        munmap(data, size);
+#endif
+        data = NULL;
+        size = 0;
+    }
+
+    /** Exchange mappings with @a other. */
+    inline void swap(MappedFile& other)
+    {
+        uint8_t * d = data;
+        size_t    s = size;
+        data = other.data;
+        size = other.size;
+        other.data = d;
+        other.size = s;
+    }
+
+private:
+    MappedFile(const MappedFile&);
+    MappedFile& operator=(const MappedFile&);
+};
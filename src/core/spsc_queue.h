@@ -0,0 +1,57 @@
+/*
+ * Copyright (c) 2015 Jonathan Howard
+ * License: https://github.com/v3n/altertum/blob/master/LICENSE
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+
+/**
+ * @file spsc_queue.h
+ * Bounded lock-free queue from one producer thread to one consumer thread
+ * Each side only writes its own index, so pushes and pops never wait on
+ * each other; a full queue makes push() fail rather than block.
+ * @a N must be a power of two, one slot stays empty.
+ */
+template <typename T, size_t N>
+struct SpscQueue
+{
+    static_assert(0 == (N & (N - 1)), "SpscQueue size must be a power of two");
+
+    SpscQueue()
+        : head(0)
+        , tail(0)
+    {
+    }
+
+    /** Producer only, returns false when full. */
+    inline bool push(const T& item)
+    {
+        size_t t = tail.load(std::memory_order_relaxed);
+        size_t next = (t + 1) & (N - 1);
+        if ( next == head.load(std::memory_order_acquire) ) return false;
+
+        items[t] = item;
+        tail.store(next, std::memory_order_release);
+        return true;
+    }
+
+    /** Consumer only, returns false when empty. */
+    inline bool pop(T& item)
+    {
+        size_t h = head.load(std::memory_order_relaxed);
+        if ( h == tail.load(std::memory_order_acquire) ) return false;
+
+        item = items[h];
+        head.store((h + 1) & (N - 1), std::memory_order_release);
+        return true;
+    }
+
+private:
+    /* on their own cache lines, so the two threads do not share one */
+    alignas(64) std::atomic<size_t> head;
+    alignas(64) std::atomic<size_t> tail;
+    T items[N];
+};
@@ -0,0 +1,71 @@
+/*
+ * Copyright (c) 2015 Jonathan Howard
+ * License: https://github.com/v3n/altertum/blob/master/LICENSE
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+/**
+ * @file triple_buffer.h
+ * Latest-value handoff from one writer thread to one reader thread
+ * The writer fills the back slot and publishes it by swapping it with the
+ * middle one; the reader swaps the middle slot into the front when a new
+ * one was published. Neither side ever waits, the reader always sees the
+ * most recent complete value and the writer never touches what the reader
+ * holds. Values published between two reads are skipped.
+ */
+template <typename T>
+struct TripleBuffer
+{
+    TripleBuffer()
+        : middle(1)
+        , back_index(2)
+        , front_index(0)
+    {
+    }
+
+    /** Writer only, the slot to fill before publish(). */
+    inline T& back()
+    {
+        return slots[back_index];
+    }
+
+    /** Writer only, hand back() to the reader. */
+    inline void publish()
+    {
+        uint32_t previous = middle.exchange(back_index | fresh, std::memory_order_acq_rel);
+        back_index = previous & ~fresh;
+    }
+
+    /**
+     * Reader only, take the latest published value as front()
+     * Returns false, keeping the front, if nothing was published since.
+     */
+    inline bool acquire()
+    {
+        if ( 0 == (middle.load(std::memory_order_relaxed) & fresh) ) return false;
+
+        uint32_t previous = middle.exchange(front_index, std::memory_order_acq_rel);
+        front_index = previous & ~fresh;
+        return true;
+    }
+
+    /** Reader only, the value taken by the last acquire(). */
+    inline const T& front() const
+    {
+        return slots[front_index];
+    }
+
+private:
+    /** set in middle while it holds a value the reader has not taken */
+    static const uint32_t fresh = 4;
+
+    T slots[3];
+
+    alignas(64) std::atomic<uint32_t> middle;
+    alignas(64) uint32_t back_index;
+    alignas(64) uint32_t front_index;
+};
@@ -3,6 +3,8 @@
  */
 
 #include <chrono>
+#include <cstdio>
+#include <cstring>
 #include <vector>
 
 #include <bgfx/bgfx.h>
@@ -17,8 +19,13 @@
 #include "bx/timer.h"
 #include "imgui/imgui.h"
 
+#include "core/job_system.h"
+
 #include "physics/entity.h"
 #include "physics/resolver.h"
+#include "physics/clock.h"
+#include "physics/simulation.h"
+#include "physics/sim_thread.h"
 
 #include "math/matrix4.h"
 
@@ -57,41 +64,27 @@ static bool is_running = false;
 static char * run_text[4] = {"Running\0\0\0", "Running.\0\0", "Running..\0", "Running..."}; 
 static double frametime;
 
-// Matrix4 * worlds;
+/** world matrix of every body, filled in one batch each frame */
+std::vector<Matrix4> worlds;
 size_t n_worlds = 5;
 
-std::vector<PhysicsBody> bodies;
-std::vector<CollisionPair> pairs;
+/** stepped on its own thread, see sim_thread.h; only touch it through sim_thread */
+Simulation simulation;
+JobSystem  jobs;
+SimThread  sim_thread;
+
+/**
+ * every input of the session, written on exit for cradle_sim --replay
+ * Only recorded when a path is given with --record <path>.
+ */
+ReplayLog  replay;
+static const char * s_replayPath = NULL;
 
 void create_bodies(size_t n_bodies)
 {
-    bodies = std::vector<PhysicsBody>(n_bodies);
-    pairs  = std::vector<CollisionPair>();
+    sim_thread.send(SimCommand::create_bodies((uint32_t)n_bodies));
 
     n_worlds = n_bodies;
-
-    for ( size_t i = 0; i < n_bodies; i++ )
-    {
-        Vector3 adjust = vector3::vector3(1.0f * i, 0.0f, 0.0f);
-        bodies[i].init_body(adjust,
-                            10.0f, 
-                            0.0f, 
-                            0.2f,
-                            2.25f
-                        );
-    }
-
-    for ( size_t i = 0; i < n_bodies; i++ )
-    {
-        CollisionPair p;
-        if ( i < n_bodies - 1 )
-        {
-            p.bodyA = &bodies[i];
-            p.bodyB = &bodies[i + 1];
-
-            pairs.push_back(p);
-        }
-    }
 }
 
 int32_t left_used;
@@ -102,37 +95,25 @@ bool   use_right;
 
 float starting_degree = 30.0f;
 
+StepEngine::Enum engine = StepEngine::Stepped;
+
 void update_starting_degrees()
 {
     if ( is_running ) return;
-    for ( std::vector<PhysicsBody>::iterator i = bodies.begin(); i != bodies.end(); i++ )
-    {
-        (*i).angle = 0.0f;
-    }
-    if ( use_left )
-    {
-        for ( std::vector<PhysicsBody>::iterator i = bodies.begin(); i != bodies.begin() + left_used; i++ )
-        {
-            (*i).angle = starting_degree;
-        }
-    }
-    if ( use_right )
-    {
 
-        for ( std::vector<PhysicsBody>::iterator i = bodies.end() - 1; i != bodies.end() - 1 - right_used; i-- )
-        {
-            (*i).angle = -starting_degree;
-        }
-    }
+    sim_thread.send(SimCommand::starting_angles( starting_degree,
+                                                 use_left  ? left_used  : 0,
+                                                 use_right ? right_used : 0
+                                            ));
+}
 
-    for ( std::vector<PhysicsBody>::iterator i = bodies.begin(); i != bodies.end(); i++ )
+int _main_(int argc, char** argv)
+{
+    for ( int i = 1; i + 1 < argc; i++ )
     {
-        (*i).lastAngle = (*i).angle;
+        if ( 0 == strcmp(argv[i], "--record") ) s_replayPath = argv[++i];
     }
-}
 
-int _main_(int /* argc */, char** /* *argv[] */)
-{
     /* windowing variables */
     uint32_t width = 1280;
     uint32_t height = 720;
@@ -228,6 +209,20 @@ int _main_(int /* argc */, char** /* *argv[] */)
     bgfx::ShaderHandle vsh = bgfx::createShader(loadMem(entry::getFileReader(), "./vs_ibl_mesh.bin") );
     bgfx::ShaderHandle fsh = bgfx::createShader(loadMem(entry::getFileReader(), "./fs_ibl_mesh.bin") );
     bgfx::ProgramHandle programMesh = bgfx::createProgram( vsh, fsh, true );
+
+    /* all bodies in one submit per mesh group, where the renderer can instance */
+    InstancedMesh instanced;
+    bgfx::ProgramHandle programInstanced = BGFX_INVALID_HANDLE;
+    if ( 0 != (bgfx::getCaps()->supported & BGFX_CAPS_INSTANCING) && instanced.load("newton.bin") )
+    {
+        const bgfx::Memory* vs_instanced = loadMem(entry::getFileReader(), "./vs_ibl_mesh_instanced.bin");
+        if ( NULL != vs_instanced )
+        {
+            vsh = bgfx::createShader(vs_instanced);
+            fsh = bgfx::createShader(loadMem(entry::getFileReader(), "./fs_ibl_mesh.bin") );
+            programInstanced = bgfx::createProgram( vsh, fsh, true );
+        }
+    }
     
     vsh = bgfx::createShader(loadMem(entry::getFileReader(), "./vs_ibl_skybox.bin") );
     fsh = bgfx::createShader(loadMem(entry::getFileReader(), "./fs_ibl_skybox.bin") );
@@ -243,18 +238,15 @@ int _main_(int /* argc */, char** /* *argv[] */)
 
     bgfx::setViewTransform(0, &view, &proj);
 
-    Matrix4 mtx;
-    bx::mtxScale((float *)&mtx, 1.0f, 1.0f, 1.0f);
-
-    bx::mtxTranslate((float *)&mtx, -(n_worlds / float(2)), 0.0f, 0.0f);
-    Matrix4 move;
-    bx::mtxTranslate((float *)&move, 1.0f, 0.0f, 0.0f);
-
     float deg = 0.0f;
     float time = 0.0f;
-    float lastTime = 0.0f;
 
-    create_bodies(n_worlds);
+    if ( NULL != s_replayPath ) simulation.replay = &replay;
+    simulation.engine = engine;
+    simulation.create_bodies(n_worlds);
+
+    /* steps on its own clock from here on, the job system runs on its thread */
+    sim_thread.start(simulation, &jobs);
 
     while ( !entry::processEvents(width, height, debug, reset, &mouseState) )
     {
@@ -295,7 +287,6 @@ int _main_(int /* argc */, char** /* *argv[] */)
         if ( !is_running && balls != n_worlds )
         {
             create_bodies( balls );
-            bx::mtxTranslate((float *)&mtx, -(n_worlds / float(2)), 0.0f, 0.0f);
         }
         if ( imguiSlider("Starting Degrees:", starting_degree, 30.0f, 80.0f, true) )
         {
@@ -328,10 +319,21 @@ int _main_(int /* argc */, char** /* *argv[] */)
 
         imguiSeparatorLine();
 
+        /* the event engine solves impacts exactly, between stepped frames */
+        bool use_events = StepEngine::Events == engine;
+        if ( imguiCheck( "Exact Impacts", use_events, !is_running ) )
+        {
+            engine = use_events ? StepEngine::Stepped : StepEngine::Events;
+            sim_thread.send(SimCommand::set_engine(engine));
+        }
+
+        imguiSeparatorLine();
+
         if ( imguiButton(is_running ? run_text[_frame_count / 30] : "Run", true ) )
         {
             _frame_count = 0;
             is_running = !is_running;
+            sim_thread.send(SimCommand::run(is_running));
             update_starting_degrees();
         }
 
@@ -403,94 +405,41 @@ int _main_(int /* argc */, char** /* *argv[] */)
         bgfx::dbgTextPrintf(0, 2, 0x6f, "Newton's Cradle simulation.");
         bgfx::dbgTextPrintf(0, 3, 0x0f, "Frame: % 7.3f[ms]", double(frameTime)*toMs );
         bgfx::dbgTextPrintf(0, 4, 0x0f, "Time: % 7.3f[s]", double(frameTime) * toS );
+        /* latest state the simulation thread published, it may lag a command by a step */
+        const BodySnapshot& snapshot = sim_thread.latest();
+        bgfx::dbgTextPrintf(0, 5, 0x0f, "Awake: %u / %u", uint32_t(snapshot.awake), uint32_t(snapshot.count) );
+
+        float alpha = snapshot.alpha_at(std::chrono::steady_clock::now());
 
-        Matrix4 _mtx = mtx;
-        _mtx.a.x = 1.0f;
-        _mtx.b.y = 1.0f;
-        _mtx.c.z = 1.0f;
-        _mtx.d.w = 1.0f;
+        /* the row is centered, the first pivot one unit in */
+        Vector3 offset = vector3::vector3(1.0f - snapshot.count / 2.0f, 0.0f, 0.0f);
+        worlds.resize(snapshot.count);
+        snapshot.transforms(alpha, offset, worlds.data());
 
-        if ( is_running )
+        /* bodies past what the instance buffers hold this frame go one by one */
+        size_t drawn = 0;
+        if ( bgfx::isValid(programInstanced) )
         {
-            for ( size_t i = 0; i < bodies.size(); i++ )
-            {
-                bodies[i].applyGravity();
-                bodies[i].update(time, time / lastTime);
-                bodies[i].solve_constraint();
-                bodies[i].postsolve_constraint();
-                bodies[i].clearForces();
-            }
-
-            std::vector<CollisionPair> active_collisions;
-            for ( size_t i = 0; i < pairs.size(); i++ )
-            {
-                CollisionPair pair = pairs[i];
-
-                if ( pairs[i].bodyA->collision.check_collision(pairs[i].bodyB->collision) )
-                {
-                    active_collisions.push_back(pairs[i]);
-
-                    Vector3 a_velocity = pair.bodyA->position - pair.bodyA->lastPosition;
-                    Vector3 b_velocity = pair.bodyB->position - pair.bodyB->lastPosition;
-
-                    if ( abs(vector3::distance(a_velocity)) > 0.00001f )
-                    {
-                        pair.bodyB->lastPosition = pair.bodyA->position;
-                        pair.bodyA->lastPosition = pair.bodyA->position;
-
-                        pair.bodyB->lastAngle -= pair.bodyA->angle - pair.bodyA->lastAngle;
-                        pair.bodyA->lastAngle = pair.bodyA->angle;
-                    }
-                    else
-                    {
-                        pair.bodyA->lastPosition = pair.bodyB->position;
-                        pair.bodyB->lastPosition = pair.bodyB->position;
-
-                        pair.bodyA->lastAngle -= pair.bodyB->angle - pair.bodyB->lastAngle;
-                        pair.bodyB->lastAngle = pair.bodyB->angle;
-                    }
-
-                    // pair.bodyA->lastPosition = pair.bodyB->position;
-                    // pair.bodyB->lastPosition = pair.bodyA->position;
-
-                    // pair.bodyA->lastAngle = pair.bodyB->angle;
-                    // pair.bodyB->lastAngle = pair.bodyA->angle;
-                }
-            }
-
-            // presolve_positions(active_collisions);
-            // for ( size_t times = 0; times < 3; times++ )
-            //     solve_positions(active_collisions);
-            // postsolve_positions(bodies);
-
-            // presolve_velocities(active_collisions);
-            // for ( size_t times = 0; times < 6; times++ )
-            //     solve_velocities(active_collisions);
+            drawn = instanced.submit(1, programInstanced, worlds.data(), uint32_t(worlds.size()) );
         }
-
-        Matrix4 rot;
-        for ( size_t i = 0; i < n_worlds; i++ )
+        for ( size_t i = drawn; i < worlds.size(); i++ )
         {
-            _mtx *= move;
-
-            bx::mtxRotateZ((float *)&rot, ( bodies[i].angle * M_PI) / 180 );
-
-            Matrix4 s_mtx = _mtx;
-            s_mtx *= rot;
-            
-            meshSubmit(mesh, 1, programMesh, (float *)&s_mtx);
+            meshSubmit(mesh, 1, programMesh, (float *)&worlds[i]);
         }
 
         /* advance to next frame (uses seperate thread) */
         bgfx::frame();
-
-        lastTime = time;
     }
 
     meshUnload(mesh);
+    instanced.unload();
 
     // Cleanup.
     bgfx::destroyProgram(programMesh);
+    if ( bgfx::isValid(programInstanced) )
+    {
+        bgfx::destroyProgram(programInstanced);
+    }
     bgfx::destroyProgram(programSky);
 
     bgfx::destroyUniform(u_camPos);
@@ -501,7 +450,14 @@ int _main_(int /* argc */, char** /* *argv[] */)
     bgfx::destroyUniform(s_texCube);
     bgfx::destroyUniform(s_texCubeIrr);
 
-    /* clean up */
+    /* clean up, the simulation is ours again once its thread stops */
+    sim_thread.stop();
+    if ( NULL != s_replayPath )
+    {
+        replay.hash(body_store::state_hash(simulation.bodies));
+        if ( !replay.save(s_replayPath) ) fprintf(stderr, "cannot write replay '%s'\n", s_replayPath);
+    }
+
     imguiDestroy();
 
     /* shutdown bgfx */
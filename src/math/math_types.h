@@ -30,12 +30,21 @@ struct Vector3
     }
 };
 
-struct Vector4
+/**
+ * Vector3 padded to four floats and aligned for SIMD
+ * w is carried along and kept at 0; see vector3a.h
+ */
+struct alignas(16) Vector3A
+{
+    float x, y, z, w;
+};
+
+struct alignas(16) Vector4
 {
     float x, y, z, w;
 };
 
-struct Quaternion
+struct alignas(16) Quaternion
 {
     float x, y, z, w;
 };
@@ -57,7 +66,7 @@ struct Matrix3
     } 
 };
 
-/** Row-column 4x4 Matrix */
+/** Row-column 4x4 Matrix, its rows aligned for SIMD */
 struct Matrix4
 {
     Vector4 a, b, c, d;
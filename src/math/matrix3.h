@@ -37,21 +37,22 @@ inline Matrix3 matrix3(Vector3 vec[3])
 namespace matrix3 
 {
 
+/** Construct rotation Matrix from unit Quarternion @a rot, laid out like matrix4::rotation(). */
 inline Matrix3 rotation(const Quaternion& rot)
 {
     Matrix3 tmp;
 
-    tmp.a.x = 1.0 - (rot.y * rot.y + rot.z * rot.z);
-    tmp.a.y = (rot.x * rot.y - rot.w * rot.z);
-    tmp.a.z = (rot.x * rot.z + rot.w * rot.y);
+    tmp.a.x = 1.0f - 2.0f * (rot.y * rot.y + rot.z * rot.z);
+    tmp.a.y = 2.0f * (rot.x * rot.y + rot.w * rot.z);
+    tmp.a.z = 2.0f * (rot.x * rot.z - rot.w * rot.y);
 
-    tmp.b.x = (rot.x * rot.y + rot.w * rot.z);
-    tmp.b.y = 1.0 - (rot.x * rot.x + rot.z * rot.z);
-    tmp.b.z = (rot.y * rot.z - rot.w * rot.x);
+    tmp.b.x = 2.0f * (rot.x * rot.y - rot.w * rot.z);
+    tmp.b.y = 1.0f - 2.0f * (rot.x * rot.x + rot.z * rot.z);
+    tmp.b.z = 2.0f * (rot.y * rot.z + rot.w * rot.x);
 
-    tmp.c.x = (rot.x * rot.z - rot.w * rot.y);
-    tmp.c.y = (rot.y * rot.z + rot.w * rot.x);
-    tmp.c.z = 1.0 - (rot.x * rot.x + rot.y * rot.y);
+    tmp.c.x = 2.0f * (rot.x * rot.z + rot.w * rot.y);
+    tmp.c.y = 2.0f * (rot.y * rot.z - rot.w * rot.x);
+    tmp.c.z = 1.0f - 2.0f * (rot.x * rot.x + rot.y * rot.y);
 
     return tmp;
 }
@@ -90,6 +90,26 @@ inline Matrix4 matrix4(const Matrix3& mat3)
     return tmp;
 }
 
+/** Sum of rows @a a to @a d scaled by the components of @a r, one row of a product. */
+inline float4 combine(float4 a, float4 b, float4 c, float4 d, const Vector4& r)
+{
+    float4 sum = simd::mul(a, simd::splat(r.x));
+    sum = simd::mul_add(b, simd::splat(r.y), sum);
+    sum = simd::mul_add(c, simd::splat(r.z), sum);
+    return simd::mul_add(d, simd::splat(r.w), sum);
+}
+
+#if ALTERTUM_SIMD_AVX
+/** combine() of two rows at once, one in each half of @a r. */
+inline __m256 combine(__m256 a, __m256 b, __m256 c, __m256 d, __m256 r)
+{
+    __m256 sum = _mm256_mul_ps(a, _mm256_shuffle_ps(r, r, _MM_SHUFFLE(0, 0, 0, 0)));
+    sum = _mm256_add_ps(sum, _mm256_mul_ps(b, _mm256_shuffle_ps(r, r, _MM_SHUFFLE(1, 1, 1, 1))));
+    sum = _mm256_add_ps(sum, _mm256_mul_ps(c, _mm256_shuffle_ps(r, r, _MM_SHUFFLE(2, 2, 2, 2))));
+    return _mm256_add_ps(sum, _mm256_mul_ps(d, _mm256_shuffle_ps(r, r, _MM_SHUFFLE(3, 3, 3, 3))));
+}
+#endif
+
 }; // namespace matrix4
 
 /** Return result of comparison of matrices @a m1 and @a m2. */
@@ -98,32 +118,45 @@ inline bool operator==(const Matrix4& m1, const Matrix4& m2)
     return (m1.a == m2.a) && (m1.b == m2.b) && (m1.c == m2.c) && (m1.d == m2.d);
 }
 
-/** Assign to @a m1 the result of matrix multiplication @a m1 * @a m2. */
+/**
+ * Assign to @a m1 the result of matrix multiplication @a m1 * @a m2
+ * Each row of the result sums the rows of @a m1 scaled by one row of
+ * @a m2, in the order the scalar expression would.
+ */
 inline Matrix4 operator*=(Matrix4& m1, const Matrix4& m2)
 {
-    Matrix4 tmp;
-
-    tmp.a.x = (m1.a.x * m2.a.x) + (m1.b.x * m2.a.y) + (m1.c.x * m2.a.z) + (m1.d.x * m2.a.w);
-    tmp.a.y = (m1.a.y * m2.a.x) + (m1.b.y * m2.a.y) + (m1.c.y * m2.a.z) + (m1.d.y * m2.a.w);
-    tmp.a.z = (m1.a.z * m2.a.x) + (m1.b.z * m2.a.y) + (m1.c.z * m2.a.z) + (m1.d.z * m2.a.w);
-    tmp.a.w = (m1.a.w * m2.a.x) + (m1.b.w * m2.a.y) + (m1.c.w * m2.a.z) + (m1.d.w * m2.a.w);
-
-    tmp.b.x = (m1.a.x * m2.b.x) + (m1.b.x * m2.b.y) + (m1.c.x * m2.b.z) + (m1.d.x * m2.b.w);
-    tmp.b.y = (m1.a.y * m2.b.x) + (m1.b.y * m2.b.y) + (m1.c.y * m2.b.z) + (m1.d.y * m2.b.w);
-    tmp.b.z = (m1.a.z * m2.b.x) + (m1.b.z * m2.b.y) + (m1.c.z * m2.b.z) + (m1.d.z * m2.b.w);
-    tmp.b.w = (m1.a.w * m2.b.x) + (m1.b.w * m2.b.y) + (m1.c.w * m2.b.z) + (m1.d.w * m2.b.w);
+#if ALTERTUM_SIMD_AVX
+    /* two rows of the result at a time */
+    __m256 a = _mm256_broadcast_ps((const __m128*)&m1.a.x);
+    __m256 b = _mm256_broadcast_ps((const __m128*)&m1.b.x);
+    __m256 c = _mm256_broadcast_ps((const __m128*)&m1.c.x);
+    __m256 d = _mm256_broadcast_ps((const __m128*)&m1.d.x);
+
+    /* m2 may be m1, read all of it before writing */
+    __m256 r_ab = _mm256_loadu_ps(&m2.a.x);
+    __m256 r_cd = _mm256_loadu_ps(&m2.c.x);
+
+    _mm256_storeu_ps(&m1.a.x, matrix4::combine(a, b, c, d, r_ab));
+    _mm256_storeu_ps(&m1.c.x, matrix4::combine(a, b, c, d, r_cd));
+#else
+    float4 a = vector4::lanes(m1.a);
+    float4 b = vector4::lanes(m1.b);
+    float4 c = vector4::lanes(m1.c);
+    float4 d = vector4::lanes(m1.d);
+
+    /* m2 may be m1, read all of it before writing */
+    float4 ra = matrix4::combine(a, b, c, d, m2.a);
+    float4 rb = matrix4::combine(a, b, c, d, m2.b);
+    float4 rc = matrix4::combine(a, b, c, d, m2.c);
+    float4 rd = matrix4::combine(a, b, c, d, m2.d);
+
+    simd::store(&m1.a.x, ra);
+    simd::store(&m1.b.x, rb);
+    simd::store(&m1.c.x, rc);
+    simd::store(&m1.d.x, rd);
+#endif
 
-    tmp.c.x = (m1.a.x * m2.c.x) + (m1.b.x * m2.c.y) + (m1.c.x * m2.c.z) + (m1.d.x * m2.c.w);
-    tmp.c.y = (m1.a.y * m2.c.x) + (m1.b.y * m2.c.y) + (m1.c.y * m2.c.z) + (m1.d.y * m2.c.w);
-    tmp.c.z = (m1.a.z * m2.c.x) + (m1.b.z * m2.c.y) + (m1.c.z * m2.c.z) + (m1.d.z * m2.c.w);
-    tmp.c.w = (m1.a.w * m2.c.x) + (m1.b.w * m2.c.y) + (m1.c.w * m2.c.z) + (m1.d.w * m2.c.w);
-
-    tmp.d.x = (m1.a.x * m2.d.x) + (m1.b.x * m2.d.y) + (m1.c.x * m2.d.z) + (m1.d.x * m2.d.w);
-    tmp.d.y = (m1.a.y * m2.d.x) + (m1.b.y * m2.d.y) + (m1.c.y * m2.d.z) + (m1.d.y * m2.d.w);
-    tmp.d.z = (m1.a.z * m2.d.x) + (m1.b.z * m2.d.y) + (m1.c.z * m2.d.z) + (m1.d.z * m2.d.w);
-    tmp.d.w = (m1.a.w * m2.d.x) + (m1.b.w * m2.d.y) + (m1.c.w * m2.d.z) + (m1.d.w * m2.d.w);
-
-    return m1 = tmp;
+    return m1;
 }
 
 /** Multiply matrix @a m1 by @a m2 and returns result. */
@@ -137,30 +170,45 @@ inline Matrix4 operator*(Matrix4 m1, const Matrix4& m2)
 namespace matrix4
 {
 
-/** Construct rotation Matrix from Quarternion @a rot. */
+/**
+ * Construct rotation Matrix from unit Quarternion @a rot
+ * Laid out like bx::mtxQuat, so it can go straight to bgfx.
+ */
 inline Matrix4 rotation(const Quaternion& rot)
 {
-    return matrix4(matrix3::rotation(rot));
-}
+    float4 q  = simd::load(&rot.x);
+    float4 q2 = simd::add(q, q);
+
+    /* 2xx 2yy 2zz, 2xy 2yz 2zx and 2wx 2wy 2wz on lanes x y z */
+    float4 square = simd::mul(q, q2);
+    float4 mixed  = simd::mul(q, simd::yzx(q2));
+    float4 by_w   = simd::mul(simd::splat(rot.w), q2);
+
+    float4 diagonal = simd::sub(simd::splat(1.0f), simd::add(simd::yzx(square), simd::yzx(simd::yzx(square))));
+    float4 plus     = simd::add(mixed, simd::yzx(simd::yzx(by_w)));
+    float4 minus    = simd::sub(mixed, simd::yzx(simd::yzx(by_w)));
 
-/** Construct transform matrix from @a scale, @a rotation, and @a translation. */
-inline Matrix4 compose(const Vector3& scale, const Quaternion& rotation, const Vector3& translation)
-{
     Matrix4 tmp;
+    tmp.a = vector4::vector4(simd::x(diagonal), simd::x(plus),     simd::z(minus),    0.0f);
+    tmp.b = vector4::vector4(simd::x(minus),    simd::y(diagonal), simd::y(plus),     0.0f);
+    tmp.c = vector4::vector4(simd::z(plus),     simd::y(minus),    simd::z(diagonal), 0.0f);
+    tmp.d = vector4::vector4(0.0f, 0.0f, 0.0f, 1.0f);
 
-    /* scale */
-    tmp.a.x = scale.x;
-    tmp.b.y = scale.y;
-    tmp.c.z = scale.z;
-    tmp.d.w = 1.0;
+    return tmp;
+}
 
-    /* rotation */
-    tmp *= matrix4::rotation(rotation);
+/**
+ * Construct transform matrix from @a scale, @a rotation, and @a translation
+ * Scales, then rotates, then translates; the translation goes in d.
+ */
+inline Matrix4 compose(const Vector3& scale, const Quaternion& rotation, const Vector3& translation)
+{
+    Matrix4 tmp = matrix4::rotation(rotation);
 
-    /* translation */
-    tmp.a.z += translation.x;
-    tmp.b.z += translation.y;
-    tmp.c.z += translation.z;
+    tmp.a = vector4::vector4(simd::mul(vector4::lanes(tmp.a), simd::splat(scale.x)));
+    tmp.b = vector4::vector4(simd::mul(vector4::lanes(tmp.b), simd::splat(scale.y)));
+    tmp.c = vector4::vector4(simd::mul(vector4::lanes(tmp.c), simd::splat(scale.z)));
+    tmp.d = vector4::vector4(translation.x, translation.y, translation.z, 1.0f);
 
     return tmp;
 }
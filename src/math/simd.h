@@ -0,0 +1,137 @@
+/*
+ * Copyright (c) 2015 Jonathan Howard
+ * License: https://github.com/v3n/altertum/blob/master/LICENSE
+ */
+
+#pragma once
+
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#   define ALTERTUM_SIMD_SSE 1
+#   include <emmintrin.h>
+#   if defined(__AVX__)
+#       define ALTERTUM_SIMD_AVX 1
+#       include <immintrin.h>
+#   endif
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#   define ALTERTUM_SIMD_NEON 1
+#   include <arm_neon.h>
+#else
+#   define ALTERTUM_SIMD_SCALAR 1
+#endif
+
+namespace altertum
+{
+
+/**
+ * @file simd.h
+ * Four-lane float vector for the math types
+ * SSE2 on x86, NEON on ARM and plain floats elsewhere, picked at compile
+ * time; AVX, when the compiler targets it, only widens Matrix4 products.
+ * Every operation rounds like its scalar counterpart and nothing is fused,
+ * so results match the scalar math bit for bit. Loads and stores are
+ * unaligned, any float[4] will do.
+ */
+#if ALTERTUM_SIMD_SSE
+typedef __m128 float4;
+#elif ALTERTUM_SIMD_NEON
+typedef float32x4_t float4;
+#else
+struct float4
+{
+    float v[4];
+};
+#endif
+
+namespace simd
+{
+
+#if ALTERTUM_SIMD_SSE
+
+inline float4 load(const float* p)                  { return _mm_loadu_ps(p); }
+inline void   store(float* p, float4 v)             { _mm_storeu_ps(p, v); }
+inline float4 set(float x, float y, float z, float w) { return _mm_setr_ps(x, y, z, w); }
+inline float4 splat(float f)                        { return _mm_set1_ps(f); }
+inline float4 add(float4 a, float4 b)               { return _mm_add_ps(a, b); }
+inline float4 sub(float4 a, float4 b)               { return _mm_sub_ps(a, b); }
+inline float4 mul(float4 a, float4 b)               { return _mm_mul_ps(a, b); }
+inline float4 div(float4 a, float4 b)               { return _mm_div_ps(a, b); }
+inline float  x(float4 v)                           { return _mm_cvtss_f32(v); }
+inline float  y(float4 v)                           { return _mm_cvtss_f32(_mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 1, 1, 1))); }
+inline float  z(float4 v)                           { return _mm_cvtss_f32(_mm_movehl_ps(v, v)); }
+inline float  w(float4 v)                           { return _mm_cvtss_f32(_mm_shuffle_ps(v, v, _MM_SHUFFLE(3, 3, 3, 3))); }
+
+/** (y, z, x, w) */
+inline float4 yzx(float4 v)                         { return _mm_shuffle_ps(v, v, _MM_SHUFFLE(3, 0, 2, 1)); }
+
+#elif ALTERTUM_SIMD_NEON
+
+inline float4 load(const float* p)                  { return vld1q_f32(p); }
+inline void   store(float* p, float4 v)             { vst1q_f32(p, v); }
+inline float4 set(float x, float y, float z, float w) { float f[4] = { x, y, z, w }; return vld1q_f32(f); }
+inline float4 splat(float f)                        { return vdupq_n_f32(f); }
+inline float4 add(float4 a, float4 b)               { return vaddq_f32(a, b); }
+inline float4 sub(float4 a, float4 b)               { return vsubq_f32(a, b); }
+inline float4 mul(float4 a, float4 b)               { return vmulq_f32(a, b); }
+inline float  x(float4 v)                           { return vgetq_lane_f32(v, 0); }
+inline float  y(float4 v)                           { return vgetq_lane_f32(v, 1); }
+inline float  z(float4 v)                           { return vgetq_lane_f32(v, 2); }
+inline float  w(float4 v)                           { return vgetq_lane_f32(v, 3); }
+
+/* ARMv7 NEON has no exact divide, go lane by lane */
+inline float4 div(float4 a, float4 b)
+{
+    return set(x(a) / x(b), y(a) / y(b), z(a) / z(b), w(a) / w(b));
+}
+
+/** (y, z, x, w) */
+inline float4 yzx(float4 v)                         { return set(y(v), z(v), x(v), w(v)); }
+
+#else
+
+inline float4 load(const float* p)                  { float4 r = { { p[0], p[1], p[2], p[3] } }; return r; }
+inline void   store(float* p, float4 v)             { p[0] = v.v[0]; p[1] = v.v[1]; p[2] = v.v[2]; p[3] = v.v[3]; }
+inline float4 set(float x, float y, float z, float w) { float4 r = { { x, y, z, w } }; return r; }
+inline float4 splat(float f)                        { return set(f, f, f, f); }
+inline float4 add(float4 a, float4 b)               { return set(a.v[0] + b.v[0], a.v[1] + b.v[1], a.v[2] + b.v[2], a.v[3] + b.v[3]); }
+inline float4 sub(float4 a, float4 b)               { return set(a.v[0] - b.v[0], a.v[1] - b.v[1], a.v[2] - b.v[2], a.v[3] - b.v[3]); }
+inline float4 mul(float4 a, float4 b)               { return set(a.v[0] * b.v[0], a.v[1] * b.v[1], a.v[2] * b.v[2], a.v[3] * b.v[3]); }
+inline float4 div(float4 a, float4 b)               { return set(a.v[0] / b.v[0], a.v[1] / b.v[1], a.v[2] / b.v[2], a.v[3] / b.v[3]); }
+inline float  x(float4 v)                           { return v.v[0]; }
+inline float  y(float4 v)                           { return v.v[1]; }
+inline float  z(float4 v)                           { return v.v[2]; }
+inline float  w(float4 v)                           { return v.v[3]; }
+
+/** (y, z, x, w) */
+inline float4 yzx(float4 v)                         { return set(v.v[1], v.v[2], v.v[0], v.v[3]); }
+
+#endif
+
+/** @a a * @a b + @a c, rounded after the multiply like the scalar expression */
+inline float4 mul_add(float4 a, float4 b, float4 c)
+{
+    return add(mul(a, b), c);
+}
+
+/** x * x + y * y + z * z of the products of @a a and @a b, in that order */
+inline float dot3(float4 a, float4 b)
+{
+    float4 p = mul(a, b);
+    return x(p) + y(p) + z(p);
+}
+
+/** Cross product of the xyz lanes, w is 0. */
+inline float4 cross3(float4 a, float4 b)
+{
+    float4 c = sub(mul(yzx(a), yzx(yzx(b))), mul(yzx(yzx(a)), yzx(b)));
+#if ALTERTUM_SIMD_SSE
+    /* w lane is a.w * b.w - a.w * b.w, force it to 0 whatever the inputs */
+    return _mm_and_ps(c, _mm_castsi128_ps(_mm_setr_epi32(-1, -1, -1, 0)));
+#else
+    return set(x(c), y(c), z(c), 0.0f);
+#endif
+}
+
+}; // namespace simd
+}; // namespace altertum
@@ -0,0 +1,140 @@
+/*
+ * Copyright (c) 2015 Jonathan Howard
+ * License: https://github.com/v3n/altertum/blob/master/LICENSE
+ */
+
+#pragma once
+
+#include <cmath>
+
+#include "math_types.h"
+#include "simd.h"
+
+namespace altertum
+{
+
+/**
+ * @file vector3a.h
+ * Implementation of Vector3A API, Vector3 math on SIMD lanes
+ * Each operation matches its Vector3 counterpart bit for bit, so the two
+ * can be mixed freely; convert where Vector3s are stored packed.
+ * @note Does not use C++ constructors to maintain aggregate struct status
+ */
+
+/* constructors */
+namespace vector3a
+{
+    /** Construct Vector3A from components */
+    inline Vector3A vector3a(float x, float y, float z)
+    {
+        Vector3A tmp = { x, y, z, 0.0f };
+        return tmp;
+    }
+
+    /** Construct Vector3A from Vector3 */
+    inline Vector3A vector3a(const Vector3& v)
+    {
+        return vector3a(v.x, v.y, v.z);
+    }
+
+    /** Construct Vector3A from SIMD lanes, dropping w */
+    inline Vector3A vector3a(float4 v)
+    {
+        Vector3A tmp;
+        simd::store(&tmp.x, v);
+        tmp.w = 0.0f;
+        return tmp;
+    }
+
+    /** Vector3 of the xyz of @a v */
+    inline Vector3 vector3(const Vector3A& v)
+    {
+        Vector3 tmp = { v.x, v.y, v.z };
+        return tmp;
+    }
+
+    /** SIMD lanes of @a v */
+    inline float4 lanes(const Vector3A& v)
+    {
+        return simd::load(&v.x);
+    }
+}; // namespace vector3a
+
+/** Returns result of comparison of vectors @a v1 and @a v2. */
+inline bool operator==(const Vector3A& v1, const Vector3A& v2)
+{
+    return (v1.x == v2.x) && (v1.y == v2.y) && (v1.z == v2.z);
+}
+
+inline Vector3A operator+(const Vector3A& v1, const Vector3A& v2)
+{
+    return vector3a::vector3a(simd::add(vector3a::lanes(v1), vector3a::lanes(v2)));
+}
+
+inline Vector3A operator+=(Vector3A& v1, const Vector3A& v2)
+{
+    return v1 = v1 + v2;
+}
+
+inline Vector3A operator-(const Vector3A& v1, const Vector3A& v2)
+{
+    return vector3a::vector3a(simd::sub(vector3a::lanes(v1), vector3a::lanes(v2)));
+}
+
+inline Vector3A operator-=(Vector3A& v1, const Vector3A& v2)
+{
+    return v1 = v1 - v2;
+}
+
+/** Returns result of scalar multiplication of Vector3A @a v and float @a f */
+inline Vector3A operator*(const Vector3A& v, const float f)
+{
+    return vector3a::vector3a(simd::mul(vector3a::lanes(v), simd::splat(f)));
+}
+
+inline Vector3A operator*=(Vector3A& v, const float f)
+{
+    return v = v * f;
+}
+
+/** scalar division */
+inline Vector3A operator/(const Vector3A& v, const float f)
+{
+    return vector3a::vector3a(simd::div(vector3a::lanes(v), simd::splat(f)));
+}
+
+inline Vector3A operator/=(Vector3A& v, const float f)
+{
+    return v = v / f;
+}
+
+/* implementation */
+namespace vector3a
+{
+
+/** cross product */
+inline Vector3A cross(const Vector3A& v1, const Vector3A& v2)
+{
+    return vector3a(simd::cross3(lanes(v1), lanes(v2)));
+}
+
+/** Dot product */
+inline float dot(const Vector3A& v1, const Vector3A& v2)
+{
+    return simd::dot3(lanes(v1), lanes(v2));
+}
+
+/* returns distance for @a v */
+inline float distance(const Vector3A& v)
+{
+    return sqrtf(dot(v, v));
+}
+
+/* Returns unit vector for @a v */
+inline Vector3A normalize(const Vector3A& v)
+{
+    return v / distance(v);
+}
+
+}; // namespace vector3a
+}; // namespace altertum
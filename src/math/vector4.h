@@ -6,10 +6,36 @@
 #pragma once
 
 #include "math_types.h"
+#include "simd.h"
 
 namespace altertum 
 {
 
+/* constructors */
+namespace vector4
+{
+    /** Construct Vector4 from components */
+    inline Vector4 vector4(float x, float y, float z, float w)
+    {
+        Vector4 tmp = { x, y, z, w };
+        return tmp;
+    }
+
+    /** Construct Vector4 from SIMD lanes */
+    inline Vector4 vector4(float4 v)
+    {
+        Vector4 tmp;
+        simd::store(&tmp.x, v);
+        return tmp;
+    }
+
+    /** SIMD lanes of @a v */
+    inline float4 lanes(const Vector4& v)
+    {
+        return simd::load(&v.x);
+    }
+}; // namespace vector4
+
 /** Returns result of comparison of vectors @a v1 and @a v2. */
 inline bool operator==(const Vector4& v1, const Vector4& v2)
 {
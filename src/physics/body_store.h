@@ -0,0 +1,765 @@
+/*
+ * Copyright (c) 2015 Jonathan Howard
+ * License: https://github.com/v3n/altertum/blob/master/LICENSE
+ */
+
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+#include "math/math_types.h"
+#include "math/simd.h"
+#include "math/vector3.h"
+
+#include "physics/clock.h"
+#include "physics/entity.h"
+#include "physics/pendulum.h"
+
+using namespace altertum;
+
+/**
+ * @file body_store.h
+ * Structure-of-arrays storage for PhysicsBody state
+ * Every field lives in its own contiguous, 64-byte aligned array so batch
+ * passes only pull in the cache lines they actually touch.
+ */
+
+/** Component-wise view of a Vector3 field. */
+struct Vector3Array
+{
+    float * x;
+    float * y;
+    float * z;
+
+    inline Vector3 get(size_t i) const
+    {
+        return vector3::vector3(x[i], y[i], z[i]);
+    }
+
+    inline void set(size_t i, const Vector3& v)
+    {
+        x[i] = v.x;
+        y[i] = v.y;
+        z[i] = v.z;
+    }
+};
+
+/**
+ * What a render transform reads of each body
+ * Points into a BodyStore, or into a copy of those arrays published to
+ * another thread.
+ */
+struct BodyPose
+{
+    const float * angle;
+    const float * lastAngle;
+    const float * pivotX;
+    const float * pivotY;
+    const float * pivotZ;
+};
+
+/**
+ * Every per-body array of the store, hot fields first.
+ * All fields are 4 bytes wide.
+ */
+#define BODY_STORE_FIELDS(_)                \
+    /* Verlet state */                       \
+    _(float,    position.x)                  \
+    _(float,    position.y)                  \
+    _(float,    position.z)                  \
+    _(float,    lastPosition.x)              \
+    _(float,    lastPosition.y)              \
+    _(float,    lastPosition.z)              \
+    _(float,    angle)                       \
+    _(float,    lastAngle)                   \
+    _(float,    force.x)                     \
+    _(float,    force.y)                     \
+    _(float,    force.z)                     \
+    _(float,    torque)                      \
+    /* per-step derived values */            \
+    _(float,    velocity.x)                  \
+    _(float,    velocity.y)                  \
+    _(float,    velocity.z)                  \
+    _(float,    angularVelocity)             \
+    _(float,    speed)                       \
+    _(float,    angularSpeed)                \
+    /* constraint and collision shape */     \
+    _(float,    mass)                        \
+    _(float,    constraintLoc.x)             \
+    _(float,    constraintLoc.y)             \
+    _(float,    constraintLoc.z)             \
+    _(float,    constraintLen)               \
+    _(float,    constraintAngle)             \
+    _(float,    origin.x)                    \
+    _(float,    origin.y)                    \
+    _(float,    origin.z)                    \
+    _(float,    radius)                      \
+    /* impulse tracking and debug */         \
+    _(float,    constraintImpulse.x)         \
+    _(float,    constraintImpulse.y)         \
+    _(float,    constraintImpulse.z)         \
+    _(float,    constraintImpulse_angle)     \
+    _(float,    impulse.x)                   \
+    _(float,    impulse.y)                   \
+    _(float,    impulse.z)                   \
+    _(float,    positionImpulse.x)           \
+    _(float,    positionImpulse.y)           \
+    _(float,    positionImpulse.z)           \
+    _(float,    angleImpulse)                \
+    _(uint32_t, total_contacts)              \
+    /* sleeping */                           \
+    _(float,    sleepTime)                   \
+    _(uint32_t, sleeping)
+
+struct BodyStore
+{
+    /** constants shared by every body, see PhysicsBody */
+    static constexpr float inertia     = 999.0f;
+    static constexpr float restitution = 1.0f;
+    static constexpr float friction    = 0.0f;
+    static constexpr float frictionAir = 0.001f;
+    static constexpr float slop        = 0.01f;
+    /** 9.81 m/s^2 at one unit per 10 cm and g_timeScale */
+    static constexpr float gravity     = 0.981f;
+
+    /** arrays are padded to a multiple of this many bodies */
+    static const size_t lanes     = 16;
+    static const size_t alignment = 64;
+
+    size_t count;
+    size_t capacity;
+
+    Vector3Array position;
+    Vector3Array lastPosition;
+    float *      angle;
+    float *      lastAngle;
+    Vector3Array force;
+    float *      torque;
+
+    Vector3Array velocity;
+    float *      angularVelocity;
+    float *      speed;
+    float *      angularSpeed;
+
+    float *      mass;
+    Vector3Array constraintLoc;
+    float *      constraintLen;
+    float *      constraintAngle;
+    Vector3Array origin;
+    float *      radius;
+
+    Vector3Array constraintImpulse;
+    float *      constraintImpulse_angle;
+    Vector3Array impulse;
+    Vector3Array positionImpulse;
+    float *      angleImpulse;
+    uint32_t *   total_contacts;
+
+    /** time spent still, and 1 while the body sleeps */
+    float *      sleepTime;
+    uint32_t *   sleeping;
+
+    BodyStore()
+        : count(0)
+        , capacity(0)
+        , memory(NULL)
+        , external(NULL)
+    {
+        bind(NULL, 0);
+    }
+
+    ~BodyStore()
+    {
+        free(memory);
+    }
+
+    /** Number of arrays in the store. */
+    static inline size_t field_count()
+    {
+        size_t n = 0;
+#define BODY_STORE_COUNT(_type, _name) n++;
+        BODY_STORE_FIELDS(BODY_STORE_COUNT)
+#undef BODY_STORE_COUNT
+        return n;
+    }
+
+    /** Bytes per array for @a capacity bodies, rounded to the alignment. */
+    static inline size_t array_size(size_t capacity)
+    {
+        size_t bytes = capacity * sizeof(float);
+        return (bytes + alignment - 1) & ~(alignment - 1);
+    }
+
+    /**
+     * Resize the store to @a n bodies
+     * Existing bodies are kept, new ones are zeroed. Only grows the
+     * underlying block when @a n exceeds the current capacity.
+     */
+    inline void resize(size_t n)
+    {
+        if ( n > capacity )
+        {
+            size_t new_capacity = (n + lanes - 1) & ~(lanes - 1);
+            size_t stride = array_size(new_capacity);
+
+            void * block = malloc(stride * field_count() + alignment);
+            memset(block, 0, stride * field_count() + alignment);
+
+            uint8_t * old_base = base();
+            size_t old_stride = array_size(capacity);
+            void * old_memory = memory;
+
+            memory = block;
+            external = NULL;
+            bind(base(), new_capacity);
+
+            for ( size_t f = 0; f < field_count() && old_base; f++ )
+            {
+                memcpy(base() + f * stride, old_base + f * old_stride, count * sizeof(float));
+            }
+
+            free(old_memory);
+        }
+
+        for ( size_t f = 0; f < field_count() && n > count; f++ )
+        {
+            memset(base() + f * array_size(capacity) + count * sizeof(float), 0, (n - count) * sizeof(float));
+        }
+
+        count = n;
+    }
+
+    /**
+     * Use @a block, laid out as block() is, as the arrays of @a n bodies
+     * The block is neither copied nor freed, so it must outlive the store
+     * or the next resize() past @a _capacity, which moves the bodies into
+     * a block of their own.
+     * @param block       aligned to BodyStore::alignment
+     * @param _capacity   bodies per array, a multiple of BodyStore::lanes
+     */
+    inline void attach(uint8_t * block, size_t n, size_t _capacity)
+    {
+        free(memory);
+        memory = NULL;
+        external = block;
+
+        bind(block, _capacity);
+        count = n;
+    }
+
+    /** Every array in one block, field after field, each array_size(capacity) long. */
+    inline const uint8_t * block() const
+    {
+        return base();
+    }
+
+    /** Bytes in block(). */
+    inline size_t block_size() const
+    {
+        return array_size(capacity) * field_count();
+    }
+
+    /** Arrays render transforms read, valid until the next resize(). */
+    inline BodyPose pose() const
+    {
+        BodyPose p = { angle, lastAngle, constraintLoc.x, constraintLoc.y, constraintLoc.z };
+        return p;
+    }
+
+    /** Make this store an exact copy of @a other. */
+    inline void assign(const BodyStore& other)
+    {
+        resize(other.count);
+
+        for ( size_t f = 0; f < field_count(); f++ )
+        {
+            memcpy(base() + f * array_size(capacity), other.base() + f * array_size(other.capacity), count * sizeof(float));
+        }
+    }
+
+    /** Same as PhysicsBody::init_body for body @a i. */
+    inline void init_body(  size_t i,
+                            const Vector3& pos,
+                            float _mass,
+                            float _angle,
+                            float _radius,
+                            float length
+                        )
+    {
+        Vector3 zero = vector3::vector3( 0.0f, 0.0f, 0.0f );
+
+        constraintAngle[i] = _angle;
+        constraintImpulse_angle[i] = 0.0f;
+        constraintLoc.set(i, pos);
+        constraintLen[i] = length;
+
+        origin.set(i, pos);
+        radius[i] = _radius;
+
+        position.set(i, pos);
+        lastPosition.set(i, pos);
+
+        mass[i] = _mass;
+
+        angle[i] = _angle;
+        lastAngle[i] = _angle;
+
+        angularVelocity[i] = 0.0f;
+        angularSpeed[i] = 0.0f;
+
+        speed[i] = 0.0f;
+        torque[i] = 0.0f;
+
+        force.set(i, zero);
+        velocity.set(i, zero);
+        impulse.set(i, zero);
+        positionImpulse.set(i, zero);
+        constraintImpulse.set(i, zero);
+        angleImpulse[i] = 0.0f;
+
+        total_contacts[i] = 0;
+
+        sleepTime[i] = 0.0f;
+        sleeping[i] = 0;
+    }
+
+    /** Copy the state of @a body into slot @a i. */
+    inline void load(size_t i, const PhysicsBody& body)
+    {
+        position.set(i, body.position);
+        lastPosition.set(i, body.lastPosition);
+        angle[i] = body.angle;
+        lastAngle[i] = body.lastAngle;
+        force.set(i, body.force);
+        torque[i] = body.torque;
+
+        velocity.set(i, body.velocity);
+        angularVelocity[i] = body.angularVelocity;
+        speed[i] = body.speed;
+        angularSpeed[i] = body.angularSpeed;
+
+        mass[i] = body.mass;
+        constraintLoc.set(i, body.constraintLoc);
+        constraintLen[i] = body.constraintLen;
+        constraintAngle[i] = body.constraintAngle;
+        origin.set(i, body.collision.origin);
+        radius[i] = body.collision.radius;
+
+        constraintImpulse.set(i, body.constraintImpulse);
+        constraintImpulse_angle[i] = body.constraintImpulse_angle;
+        impulse.set(i, body.impulse);
+        positionImpulse.set(i, body.positionImpulse);
+        total_contacts[i] = (uint32_t)body.total_contacts;
+    }
+
+    /** Copy slot @a i back out into @a body. */
+    inline void store(size_t i, PhysicsBody& body) const
+    {
+        body.position = position.get(i);
+        body.lastPosition = lastPosition.get(i);
+        body.angle = angle[i];
+        body.lastAngle = lastAngle[i];
+        body.force = force.get(i);
+        body.torque = torque[i];
+
+        body.velocity = velocity.get(i);
+        body.angularVelocity = angularVelocity[i];
+        body.speed = speed[i];
+        body.angularSpeed = angularSpeed[i];
+
+        body.mass = mass[i];
+        body.constraintLoc = constraintLoc.get(i);
+        body.constraintLen = constraintLen[i];
+        body.constraintAngle = constraintAngle[i];
+        body.collision.origin = origin.get(i);
+        body.collision.radius = radius[i];
+
+        body.constraintImpulse = constraintImpulse.get(i);
+        body.constraintImpulse_angle = constraintImpulse_angle[i];
+        body.impulse = impulse.get(i);
+        body.positionImpulse = positionImpulse.get(i);
+        body.total_contacts = total_contacts[i];
+    }
+
+    /** Collision shape of body @a i. */
+    inline BoundingSphere sphere(size_t i) const
+    {
+        BoundingSphere s;
+        s.origin = origin.get(i);
+        s.radius = radius[i];
+        return s;
+    }
+
+private:
+    BodyStore(const BodyStore&);
+    BodyStore& operator=(const BodyStore&);
+
+    inline uint8_t * base() const
+    {
+        if ( NULL != external ) return external;
+        if ( NULL == memory ) return NULL;
+        return (uint8_t *)(((uintptr_t)memory + alignment - 1) & ~(uintptr_t)(alignment - 1));
+    }
+
+    /** Point every field at its array inside @a block. */
+    inline void bind(uint8_t * block, size_t _capacity)
+    {
+        size_t stride = array_size(_capacity);
+        size_t offset = 0;
+#define BODY_STORE_BIND(_type, _name) \
+        _name = block ? (_type *)(block + offset) : NULL; \
+        offset += stride;
+        BODY_STORE_FIELDS(BODY_STORE_BIND)
+#undef BODY_STORE_BIND
+        capacity = _capacity;
+    }
+
+    void * memory;
+    /** block the arrays live in when attach()ed, not owned */
+    uint8_t * external;
+};
+
+/** How the per-body chain advances each swing angle. */
+struct SwingIntegrator
+{
+    enum Enum
+    {
+        /** Verlet on the angle and the sphere, with gravity as a torque */
+        Verlet,
+        /** kick-drift-kick in angle space, second order */
+        Leapfrog,
+        /** Yoshida's composition of three leapfrogs, fourth order */
+        Yoshida,
+        /** closed-form swing, see pendulum.h */
+        Exact,
+
+        Count
+    };
+};
+
+/** Yoshida fourth order drift and kick weights */
+static const float g_yoshidaDrift[4] = { 0.6756035959798289f, -0.1756035959798288f, -0.1756035959798288f, 0.6756035959798289f };
+static const float g_yoshidaKick[3]  = { 1.3512071919596578f, -1.7024143839193153f, 1.3512071919596578f };
+
+/**
+ * Batch step functions, each operating on bodies [begin, end)
+ * update matches PhysicsBody::update; gravity and the string act on the
+ * swing angle, which is the state of each pendulum.
+ */
+namespace body_store
+{
+
+/** Gravity about each pivot, as a torque on the swing angle. */
+inline void applyGravity(BodyStore& s, size_t begin, size_t end)
+{
+    const float to_radians = float(M_PI / 180);
+
+    for ( size_t i = begin; i < end; i++ )
+    {
+        /* angular acceleration in degrees of -g / length * sin(angle) */
+        float k = BodyStore::inertia * (BodyStore::gravity / s.constraintLen[i]) / to_radians;
+        s.torque[i] -= k * sinf(s.angle[i] * to_radians);
+    }
+}
+
+/**
+ * update bodies
+ * @param deltaTime  time difference
+ * @param correction deltaTime / lastDeltaTime
+ */
+inline void update(BodyStore& s, size_t begin, size_t end, float deltaTime, float correction)
+{
+    float deltaTimeSq = deltaTime * deltaTime;
+    float frictionAir = 1 - BodyStore::frictionAir;
+
+    for ( size_t i = begin; i < end; i++ )
+    {
+        /* Verlet integration for velocity */
+        float mass = s.mass[i];
+        float vx = ((s.position.x[i] - s.lastPosition.x[i]) * frictionAir * correction) + (s.force.x[i] / mass) * deltaTimeSq;
+        float vy = ((s.position.y[i] - s.lastPosition.y[i]) * frictionAir * correction) + (s.force.y[i] / mass) * deltaTimeSq;
+        float vz = ((s.position.z[i] - s.lastPosition.z[i]) * frictionAir * correction) + (s.force.z[i] / mass) * deltaTimeSq;
+
+        s.velocity.x[i] = vx;
+        s.velocity.y[i] = vy;
+        s.velocity.z[i] = vz;
+
+        s.lastPosition.x[i] = s.position.x[i];
+        s.lastPosition.y[i] = s.position.y[i];
+        s.lastPosition.z[i] = s.position.z[i];
+
+        s.position.x[i] += vx;
+        s.position.y[i] += vy;
+        s.position.z[i] += vz;
+
+        /* Verlet integration for angular velocity */
+        float angularVelocity = ((s.angle[i] - s.lastAngle[i]) * frictionAir * correction) + (s.torque[i] / BodyStore::inertia) * deltaTimeSq;
+        s.angularVelocity[i] = angularVelocity;
+
+        s.lastAngle[i] = s.angle[i];
+        s.angle[i] += angularVelocity;
+
+        /* track speed and acceleration */
+        s.speed[i] = sqrtf(vx * vx + vy * vy + vz * vz);
+        s.angularSpeed[i] = fabsf(angularVelocity);
+    }
+}
+
+/**
+ * Advance each swing angle with @a integrator, anything but Verlet
+ * The rate is angle - lastAngle, read as the rate now in degrees per step
+ * and written back the same way, so the contact solver changes it as it
+ * does under Verlet. Only gravity acts; air friction takes its toll per
+ * fixed step, whatever @a deltaTime is. The spheres are left for
+ * solve_constraint to place.
+ * @param deltaTime  time difference
+ * @param correction deltaTime / lastDeltaTime
+ */
+inline void swing(BodyStore& s, size_t begin, size_t end, float deltaTime, float correction, SwingIntegrator::Enum integrator)
+{
+    const float to_radians = float(M_PI / 180);
+    float damping = powf(1 - BodyStore::frictionAir, deltaTime / g_fixedDeltaTime) * correction;
+
+    for ( size_t i = begin; i < end; i++ )
+    {
+        /* radians and radians per step, so the acceleration is -k sin */
+        float angle = s.angle[i] * to_radians;
+        float rate = (s.angle[i] - s.lastAngle[i]) * damping * to_radians;
+        float k = BodyStore::gravity / s.constraintLen[i] * deltaTime * deltaTime;
+
+        if ( SwingIntegrator::Leapfrog == integrator )
+        {
+            rate  -= 0.5f * k * sinf(angle);
+            angle += rate;
+            rate  -= 0.5f * k * sinf(angle);
+        }
+        else if ( SwingIntegrator::Yoshida == integrator )
+        {
+            for ( size_t stage = 0; stage < 3; stage++ )
+            {
+                angle += g_yoshidaDrift[stage] * rate;
+                rate  -= g_yoshidaKick[stage] * k * sinf(angle);
+            }
+            angle += g_yoshidaDrift[3] * rate;
+        }
+        else
+        {
+            /* one step of the swing through this state, in time units */
+            double w = sqrt(double(BodyStore::gravity) / s.constraintLen[i]);
+            double exact_angle, exact_rate;
+
+            Swing motion;
+            motion.set(angle, double(rate) / deltaTime, w, 0.0);
+            motion.at(deltaTime, exact_angle, exact_rate);
+
+            angle = float(exact_angle);
+            rate  = float(exact_rate * deltaTime);
+        }
+
+        s.lastPosition.x[i] = s.position.x[i];
+        s.lastPosition.y[i] = s.position.y[i];
+        s.lastPosition.z[i] = s.position.z[i];
+
+        s.angle[i] = angle / to_radians;
+        s.angularVelocity[i] = rate / to_radians;
+        s.lastAngle[i] = s.angle[i] - s.angularVelocity[i];
+        s.angularSpeed[i] = fabsf(s.angularVelocity[i]);
+    }
+}
+
+/**
+ * Put each sphere at the end of its string
+ * The swing angle is the state of a pendulum, so the string is always
+ * exactly its length; position, velocity and the collision sphere follow
+ * from the angle and the position of the last step. Positive angles swing
+ * toward -x, as the renderer rotates the mesh.
+ */
+inline void solve_constraint(BodyStore& s, size_t begin, size_t end)
+{
+    const float to_radians = float(M_PI / 180);
+
+    for ( size_t i = begin; i < end; i++ )
+    {
+        float rad = s.angle[i] * to_radians;
+        float length = s.constraintLen[i];
+
+        float px = s.constraintLoc.x[i] - length * sinf(rad);
+        float py = s.constraintLoc.y[i] - length * cosf(rad);
+        float pz = s.constraintLoc.z[i];
+
+        float vx = px - s.lastPosition.x[i];
+        float vy = py - s.lastPosition.y[i];
+        float vz = pz - s.lastPosition.z[i];
+
+        s.velocity.x[i] = vx;
+        s.velocity.y[i] = vy;
+        s.velocity.z[i] = vz;
+        s.speed[i] = sqrtf(vx * vx + vy * vy + vz * vz);
+
+        s.position.x[i] = px;
+        s.position.y[i] = py;
+        s.position.z[i] = pz;
+
+        s.origin.x[i] = px;
+        s.origin.y[i] = py;
+        s.origin.z[i] = pz;
+    }
+}
+
+/**
+ * World matrix of a pendulum swung by the sine @a sin and cosine @a cos of
+ * its angle, hung from (@a x, @a y, @a z); the bx::mtxRotateZ layout with
+ * the translation in d.
+ */
+inline void write_transform(Matrix4& m, float sin, float cos, float x, float y, float z)
+{
+    simd::store(&m.a.x, simd::set( cos, -sin, 0.0f, 0.0f));
+    simd::store(&m.b.x, simd::set( sin,  cos, 0.0f, 0.0f));
+    simd::store(&m.c.x, simd::set(0.0f, 0.0f, 1.0f, 0.0f));
+    simd::store(&m.d.x, simd::set(   x,    y,    z, 1.0f));
+}
+
+/**
+ * Render transform of each body into @a out[i]
+ * The mesh is the whole pendulum, so it rotates about its pivot by the
+ * angle @a alpha of the way from lastAngle to angle, and the pivot is moved
+ * by @a offset into the scene.
+ */
+inline void transforms(const BodyPose& p, size_t begin, size_t end, float alpha, const Vector3& offset, Matrix4* out)
+{
+    const float to_radians = float(M_PI / 180);
+
+    for ( size_t i = begin; i < end; i++ )
+    {
+        float rad = (p.lastAngle[i] + (p.angle[i] - p.lastAngle[i]) * alpha) * to_radians;
+
+        write_transform(out[i], sinf(rad), cosf(rad),
+                        p.pivotX[i] + offset.x,
+                        p.pivotY[i] + offset.y,
+                        p.pivotZ[i] + offset.z
+                    );
+    }
+}
+
+/**
+ * Move body @a i back along its last step of @a deltaTime to fraction
+ * @a t of it
+ * The angle is the one nearest the point @a t along the straight path
+ * from lastPosition to position. Under the angle-space integrators the
+ * rate is the rate now, so it is taken back to the one the swing had at
+ * that angle, keeping its energy; under Verlet it is the rate over the
+ * step, and is kept.
+ */
+inline void rewind(BodyStore& s, size_t i, float t, float deltaTime, SwingIntegrator::Enum integrator)
+{
+    const float to_degrees = float(180 / M_PI);
+    const float to_radians = float(M_PI / 180);
+
+    float px = s.lastPosition.x[i] + (s.position.x[i] - s.lastPosition.x[i]) * t;
+    float py = s.lastPosition.y[i] + (s.position.y[i] - s.lastPosition.y[i]) * t;
+
+    float rate = s.angle[i] - s.lastAngle[i];
+    float angle = atan2f(s.constraintLoc.x[i] - px, s.constraintLoc.y[i] - py) * to_degrees;
+
+    if ( SwingIntegrator::Verlet != integrator )
+    {
+        /* rate^2 + 2 g / length (1 - cos), in degrees per step, is constant along a swing */
+        float k = 2 * BodyStore::gravity / s.constraintLen[i] * deltaTime * deltaTime * to_degrees * to_degrees;
+        float rate_sq = rate * rate + k * (cosf(angle * to_radians) - cosf(s.angle[i] * to_radians));
+        rate = copysignf(sqrtf(rate_sq > 0 ? rate_sq : 0.0f), rate);
+    }
+
+    s.angle[i] = angle;
+    s.lastAngle[i] = angle - rate;
+
+    solve_constraint(s, i, i + 1);
+}
+
+/**
+ * Track how long each body has been still
+ * A body is still while its sphere moves slower than @a stillSpeed per
+ * step; any faster step starts the count over.
+ */
+inline void track_rest(BodyStore& s, size_t begin, size_t end, float deltaTime, float stillSpeed)
+{
+    const float to_radians = float(M_PI / 180);
+
+    for ( size_t i = begin; i < end; i++ )
+    {
+        float speed = s.constraintLen[i] * fabsf(s.angle[i] - s.lastAngle[i]) * to_radians;
+        s.sleepTime[i] = speed < stillSpeed ? s.sleepTime[i] + deltaTime : 0.0f;
+    }
+}
+
+inline void postsolve_constraint(BodyStore& s, size_t begin, size_t end)
+{
+    for ( size_t i = begin; i < end; i++ )
+    {
+        s.impulse.x[i] = 0.0f;
+        s.impulse.y[i] = 0.0f;
+        s.impulse.z[i] = s.constraintImpulse.z[i];
+    }
+}
+
+inline void clearForces(BodyStore& s, size_t begin, size_t end)
+{
+    for ( size_t i = begin; i < end; i++ )
+    {
+        s.force.x[i] = 0.0f;
+        s.force.y[i] = 0.0f;
+        s.force.z[i] = 0.0f;
+        s.torque[i] = 0.0f;
+    }
+}
+
+/**
+ * Energy of bodies [begin, end), kinetic plus potential above the bottom
+ * Swing rates are those of the last step of @a deltaTime.
+ */
+inline double energy(const BodyStore& s, size_t begin, size_t end, float deltaTime)
+{
+    const double to_radians = M_PI / 180;
+
+    double total = 0.0;
+    for ( size_t i = begin; i < end; i++ )
+    {
+        double length = s.constraintLen[i];
+        double rate = (s.angle[i] - s.lastAngle[i]) * to_radians / deltaTime;
+
+        total += s.mass[i] * (0.5 * length * length * rate * rate
+                            + BodyStore::gravity * length * (1 - cos(s.angle[i] * to_radians)));
+    }
+    return total;
+}
+
+/**
+ * FNV-1a hash of the motion state of every body
+ * Positions and angles of this and the last step, bit-for-bit, so two
+ * runs match only if they took exactly the same steps.
+ */
+inline uint64_t state_hash(const BodyStore& s)
+{
+    const float* fields[] =
+    {
+        s.position.x, s.position.y, s.position.z,
+        s.lastPosition.x, s.lastPosition.y, s.lastPosition.z,
+        s.angle, s.lastAngle,
+    };
+
+    uint64_t hash = 14695981039346656037ull;
+    for ( size_t f = 0; f < sizeof(fields) / sizeof(fields[0]); f++ )
+    {
+        const uint8_t* bytes = (const uint8_t*)fields[f];
+        for ( size_t i = 0; i < s.count * sizeof(float); i++ )
+        {
+            hash = (hash ^ bytes[i]) * 1099511628211ull;
+        }
+    }
+
+    return hash;
+}
+
+}; // namespace body_store
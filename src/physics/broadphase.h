@@ -0,0 +1,642 @@
+/*
+ * Copyright (c) 2015 Jonathan Howard
+ * License: https://github.com/v3n/altertum/blob/master/LICENSE
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "physics/body_store.h"
+#include "physics/resolver.h"
+
+/**
+ * @file broadphase.h
+ * Broadphases producing candidate CollisionPairs from BoundingSphere::origin
+ * Bounds cover each sphere over its last step, from lastPosition to
+ * origin, so pairs that crossed within a step are still found for the
+ * swept test (see time_of_impact()).
+ */
+
+/** Lower and upper bound along @a axis of the sphere of body @a i over its last step. */
+inline void swept_bounds(const BodyStore& bodies, const Vector3Array& origin, const Vector3Array& last,
+                         uint32_t i, int axis, float& lower, float& upper)
+{
+    const float * now  = 0 == axis ? origin.x : (1 == axis ? origin.y : origin.z);
+    const float * then = 0 == axis ? last.x   : (1 == axis ? last.y   : last.z);
+
+    lower = (now[i] < then[i] ? now[i] : then[i]) - bodies.radius[i];
+    upper = (now[i] < then[i] ? then[i] : now[i]) + bodies.radius[i];
+}
+
+/** Broadphase used by the simulation. */
+struct BroadphaseType
+{
+    enum Enum
+    {
+        /** uniform grid, any layout */
+        Grid,
+        /** sort and sweep along x, best for a cradle laid out along x */
+        SweepAndPrune,
+
+        Count
+    };
+};
+
+/**
+ * Flat map from a 64 bit key to a 32 bit index
+ * Open addressing with linear probing and backward shift deletion, so
+ * removals leave no tombstones and the table only grows, never shrinks.
+ * All ones is reserved as the empty key.
+ */
+struct IndexMap
+{
+    static const uint64_t empty = ~uint64_t(0);
+
+    IndexMap()
+        : count(0)
+    {
+    }
+
+    inline void clear()
+    {
+        slots.assign(slots.size(), Slot{ empty, 0 });
+        count = 0;
+    }
+
+    /** Key of an unordered body pair. */
+    static inline uint64_t pair_key(uint32_t a, uint32_t b)
+    {
+        return a < b ? ((uint64_t)a << 32) | b : ((uint64_t)b << 32) | a;
+    }
+
+    /** Make room for @a n keys without growing. */
+    inline void reserve(size_t n)
+    {
+        while ( n * 2 > slots.size() ) grow();
+    }
+
+    /** Index stored for @a k, or NULL. */
+    inline uint32_t* find(uint64_t k)
+    {
+        if ( slots.empty() ) return NULL;
+
+        for ( size_t i = hash(k); ; i = (i + 1) & mask() )
+        {
+            if ( slots[i].key == k )     return &slots[i].index;
+            if ( slots[i].key == empty ) return NULL;
+        }
+    }
+
+    inline void insert(uint64_t k, uint32_t index)
+    {
+        if ( (count + 1) * 2 > slots.size() )
+        {
+            grow();
+        }
+
+        size_t i = hash(k);
+        while ( slots[i].key != empty ) i = (i + 1) & mask();
+
+        slots[i].key   = k;
+        slots[i].index = index;
+        count++;
+    }
+
+    inline void remove(uint64_t k)
+    {
+        size_t i = hash(k);
+        while ( slots[i].key != k ) i = (i + 1) & mask();
+
+        /* shift back every later entry of the run that may probe past i */
+        for ( size_t j = (i + 1) & mask(); slots[j].key != empty; j = (j + 1) & mask() )
+        {
+            size_t home = hash(slots[j].key);
+            if ( ((j - home) & mask()) >= ((j - i) & mask()) )
+            {
+                slots[i] = slots[j];
+                i = j;
+            }
+        }
+
+        slots[i].key = empty;
+        count--;
+    }
+
+private:
+    struct Slot
+    {
+        uint64_t key;
+        uint32_t index;
+    };
+
+    inline size_t mask() const { return slots.size() - 1; }
+
+    inline size_t hash(uint64_t k) const
+    {
+        k ^= k >> 33;
+        k *= 0xff51afd7ed558ccdull;
+        k ^= k >> 33;
+        return (size_t)k & mask();
+    }
+
+    inline void grow()
+    {
+        std::vector<Slot> old;
+        old.swap(slots);
+        slots.assign(old.empty() ? 64 : old.size() * 2, Slot{ empty, 0 });
+        count = 0;
+
+        for ( size_t i = 0; i < old.size(); i++ )
+        {
+            if ( old[i].key != empty ) insert(old[i].key, old[i].index);
+        }
+    }
+
+    std::vector<Slot> slots;
+    size_t count;
+};
+
+/**
+ * Uniform grid broadphase
+ * Cells are at least one sphere diameter wide, so any two overlapping
+ * spheres sit in the same or neighboring cells. Bodies are only moved
+ * between cell lists when they cross a cell boundary.
+ */
+struct SpatialHash
+{
+    /** Cell coordinates of a point. */
+    struct Cell
+    {
+        int32_t x, y, z;
+    };
+
+    float cellSize;
+
+    SpatialHash()
+        : cellSize(1.0f)
+    {
+    }
+
+    /** Drop every body and set the cell size, at least the largest diameter. */
+    inline void reset(float _cellSize)
+    {
+        cellSize = _cellSize;
+
+        body_cell.clear();
+        body_slot.clear();
+        cell_index.clear();
+        occupied.clear();
+
+        /* keep every cell list and its capacity for reuse */
+        free_cells.clear();
+        for ( size_t i = cells.size(); i-- > 0; )
+        {
+            cells[i].clear();
+            free_cells.push_back((uint32_t)i);
+        }
+    }
+
+    /**
+     * Make room for @a n_bodies bodies and @a n_pairs candidate pairs
+     * Never more cells than bodies are occupied, so a list is set aside
+     * for each body up front. Must follow reset().
+     */
+    inline void reserve(size_t n_bodies, size_t n_pairs)
+    {
+        body_cell.reserve(n_bodies);
+        body_slot.reserve(n_bodies);
+        cell_index.reserve(n_bodies);
+        occupied.reserve(n_bodies);
+        free_cells.reserve(n_bodies);
+
+        while ( cells.size() < n_bodies )
+        {
+            free_cells.push_back((uint32_t)cells.size());
+            cells.push_back(std::vector<uint32_t>());
+            cells.back().reserve(8);
+            occupied_slot.push_back(0);
+        }
+
+        keys.reserve(n_pairs);
+        previous.reserve(n_pairs);
+    }
+
+    /** Cell containing @a p. */
+    inline Cell cell_of(const Vector3& p) const
+    {
+        Cell c;
+        c.x = (int32_t)floorf(p.x / cellSize);
+        c.y = (int32_t)floorf(p.y / cellSize);
+        c.z = (int32_t)floorf(p.z / cellSize);
+        return c;
+    }
+
+    /**
+     * Pack cell coordinates into a key
+     * x gets 26 bits, y (the string axis) 12 and z 25, leaving the top bit
+     * clear; coordinates outside that range wrap, which can only add
+     * candidates, never lose them.
+     */
+    static inline uint64_t key(const Cell& c)
+    {
+        return ((uint64_t)(c.x & 0x3ffffff) << 37)
+             | ((uint64_t)(c.y & 0xfff) << 25)
+             |  (uint64_t)(c.z & 0x1ffffff);
+    }
+
+    /** Move bodies whose origin changed cell since the last call. */
+    inline void update(const BodyStore& bodies)
+    {
+        size_t first_new = body_cell.size();
+
+        if ( bodies.count < first_new )
+        {
+            reset(cellSize);
+            first_new = 0;
+        }
+
+        body_cell.resize(bodies.count);
+        body_slot.resize(bodies.count);
+
+        for ( size_t i = 0; i < bodies.count; i++ )
+        {
+            uint64_t k = key(cell_of(bodies.origin.get(i)));
+
+            if ( i < first_new )
+            {
+                if ( k == body_cell[i] ) continue;
+                remove(i);
+            }
+
+            insert(i, k);
+        }
+    }
+
+    /**
+     * Emit every pair whose bounding boxes overlap into @a pairs
+     * Expected O(n): each occupied cell is tested against itself and half of
+     * its 26 neighbors. Pairs come out sorted by (bodyA, bodyB), bodyA < bodyB,
+     * and pairs already found by the last call keep their solver state.
+     */
+    inline void find_pairs(const BodyStore& bodies, std::vector<CollisionPair>& pairs)
+    {
+        keys.clear();
+
+        for ( size_t o = 0; o < occupied.size(); o++ )
+        {
+            const std::vector<uint32_t>& home = cells[occupied[o]];
+
+            /* pairs inside the cell */
+            for ( size_t i = 0; i < home.size(); i++ )
+            {
+                for ( size_t j = i + 1; j < home.size(); j++ )
+                {
+                    test(bodies, home[i], home[j]);
+                }
+            }
+
+            /* pairs with the 13 neighbors that come after this cell */
+            Cell c = cell_of(bodies.origin.get(home[0]));
+            for ( int dx = -1; dx <= 1; dx++ )
+            for ( int dy = -1; dy <= 1; dy++ )
+            for ( int dz = -1; dz <= 1; dz++ )
+            {
+                if ( dx < 0 || (0 == dx && dy < 0) || (0 == dx && 0 == dy && dz <= 0) ) continue;
+
+                Cell n = { c.x + dx, c.y + dy, c.z + dz };
+                const uint32_t * other = cell_index.find(key(n));
+                if ( NULL == other || *other == occupied[o] ) continue;
+
+                const std::vector<uint32_t>& neighbor = cells[*other];
+                for ( size_t i = 0; i < home.size(); i++ )
+                {
+                    for ( size_t j = 0; j < neighbor.size(); j++ )
+                    {
+                        test(bodies, home[i], neighbor[j]);
+                    }
+                }
+            }
+        }
+
+        /* wrapped keys can alias two cells, drop any pair found twice */
+        std::sort(keys.begin(), keys.end());
+        keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+
+        /* pairs found last time keep their cached impulses; both lists
+           are sorted, so match them up in one pass */
+        previous.swap(pairs);
+        pairs.resize(keys.size());
+
+        size_t j = 0;
+        for ( size_t i = 0; i < keys.size(); i++ )
+        {
+            while ( j < previous.size() && key_of(previous[j]) < keys[i] ) j++;
+
+            if ( j < previous.size() && key_of(previous[j]) == keys[i] )
+            {
+                pairs[i] = previous[j];
+            }
+            else
+            {
+                pairs[i] = CollisionPair();
+                pairs[i].bodyA = (uint32_t)(keys[i] >> 32);
+                pairs[i].bodyB = (uint32_t)(keys[i] & 0xffffffff);
+            }
+        }
+    }
+
+private:
+    static inline uint64_t key_of(const CollisionPair& p)
+    {
+        return ((uint64_t)p.bodyA << 32) | p.bodyB;
+    }
+
+    inline void insert(size_t body, uint64_t k)
+    {
+        uint32_t * found = cell_index.find(k);
+        uint32_t cell;
+
+        if ( NULL == found )
+        {
+            if ( free_cells.empty() )
+            {
+                cell = (uint32_t)cells.size();
+                cells.push_back(std::vector<uint32_t>());
+                occupied_slot.push_back(0);
+            }
+            else
+            {
+                cell = free_cells.back();
+                free_cells.pop_back();
+            }
+            cell_index.insert(k, cell);
+
+            occupied_slot[cell] = (uint32_t)occupied.size();
+            occupied.push_back(cell);
+        }
+        else
+        {
+            cell = *found;
+        }
+
+        body_cell[body] = k;
+        body_slot[body] = (uint32_t)cells[cell].size();
+        cells[cell].push_back((uint32_t)body);
+    }
+
+    inline void remove(size_t body)
+    {
+        uint32_t cell = *cell_index.find(body_cell[body]);
+        std::vector<uint32_t>& list = cells[cell];
+        uint32_t slot = body_slot[body];
+
+        /* swap-erase, the moved body takes over the slot */
+        list[slot] = list.back();
+        body_slot[list[slot]] = slot;
+        list.pop_back();
+
+        /* empty cells leave the map, their list keeps its capacity for reuse */
+        if ( list.empty() )
+        {
+            uint32_t moved = occupied.back();
+            occupied[occupied_slot[cell]] = moved;
+            occupied_slot[moved] = occupied_slot[cell];
+            occupied.pop_back();
+
+            free_cells.push_back(cell);
+            cell_index.remove(body_cell[body]);
+        }
+    }
+
+    /** Keep the pair if the swept boxes overlap; sweeps longer than a cell may be missed. */
+    inline void test(const BodyStore& bodies, uint32_t a, uint32_t b)
+    {
+        for ( int axis = 0; axis < 3; axis++ )
+        {
+            float lower_a, upper_a, lower_b, upper_b;
+            swept_bounds(bodies, bodies.origin, bodies.lastPosition, a, axis, lower_a, upper_a);
+            swept_bounds(bodies, bodies.origin, bodies.lastPosition, b, axis, lower_b, upper_b);
+
+            if ( lower_a > upper_b || lower_b > upper_a ) return;
+        }
+
+        if ( a > b ) std::swap(a, b);
+        keys.push_back(((uint64_t)a << 32) | b);
+    }
+
+    /** current cell key and position in that cell's list, per body */
+    std::vector<uint64_t> body_cell;
+    std::vector<uint32_t> body_slot;
+
+    /** occupied cell key to index into cells */
+    IndexMap cell_index;
+    std::vector< std::vector<uint32_t> > cells;
+    std::vector<uint32_t> free_cells;
+
+    /** indices of non-empty cells, and each cell's position in that list */
+    std::vector<uint32_t> occupied;
+    std::vector<uint32_t> occupied_slot;
+
+    /** scratch, candidate pairs packed as (a << 32 | b) */
+    std::vector<uint64_t> keys;
+    /** scratch, the pairs of the last pass */
+    std::vector<CollisionPair> previous;
+};
+
+/**
+ * Sort and sweep broadphase along x
+ * Keeps the interval endpoints of every sphere sorted from one step to the
+ * next with an insertion sort, which is near O(n) while bodies barely
+ * reorder. Every swap of a start past an end, or back, adds or removes one
+ * overlap, and only those changes are applied to the pair list.
+ * Only x is swept, so pairs can overlap in x yet be apart in y or z; the
+ * 3D narrowphase filters those out.
+ */
+struct SweepAndPrune
+{
+    /** Forget every body, the next update() sorts from scratch. */
+    inline void reset()
+    {
+        endpoints.clear();
+        overlaps.clear();
+    }
+
+    /** Make room for @a n_bodies bodies and @a n_pairs overlaps. */
+    inline void reserve(size_t n_bodies, size_t n_pairs)
+    {
+        endpoints.reserve(2 * n_bodies);
+        overlaps.reserve(n_pairs);
+    }
+
+    /** Number of endpoints, two per body once update() has run. */
+    inline size_t endpoint_count() const
+    {
+        return endpoints.size();
+    }
+
+    /** Id of the endpoint at sorted position @a i, body << 1 | 1 for an interval end. */
+    inline uint32_t endpoint_id(size_t i) const
+    {
+        return endpoints[i].id;
+    }
+
+    /**
+     * Take the endpoint order @a ids from endpoint_id(), with @a pairs as
+     * the current overlaps
+     * The next update() then carries on exactly as the sweep that saved
+     * them would have, including the order of equal endpoints. Values are
+     * left for that update() to read from the bodies.
+     */
+    inline void restore(const uint32_t* ids, size_t n, const std::vector<CollisionPair>& pairs)
+    {
+        endpoints.resize(n);
+        for ( size_t i = 0; i < n; i++ )
+        {
+            endpoints[i].id    = ids[i];
+            endpoints[i].value = 0.0f;
+        }
+
+        overlaps.clear();
+        overlaps.reserve(pairs.size());
+        for ( size_t i = 0; i < pairs.size(); i++ )
+        {
+            overlaps.insert(IndexMap::pair_key(pairs[i].bodyA, pairs[i].bodyB), (uint32_t)i);
+        }
+    }
+
+    /** Re-sort endpoints and apply overlap changes to @a pairs. */
+    inline void update(const BodyStore& bodies, std::vector<CollisionPair>& pairs)
+    {
+        if ( endpoints.size() != 2 * bodies.count )
+        {
+            rebuild(bodies, pairs);
+            return;
+        }
+
+        for ( size_t i = 0; i < endpoints.size(); i++ )
+        {
+            endpoints[i].value = value(bodies, endpoints[i].id);
+        }
+
+        for ( size_t i = 1; i < endpoints.size(); i++ )
+        {
+            Endpoint e = endpoints[i];
+            size_t j = i;
+
+            for ( ; j > 0 && less(e, endpoints[j - 1]); j-- )
+            {
+                const Endpoint& other = endpoints[j - 1];
+
+                /* a start moving below an end begins an overlap, an end
+                   moving below a start ends one */
+                if ( !is_max(e) && is_max(other) )
+                {
+                    add(pairs, body(e), body(other));
+                }
+                else if ( is_max(e) && !is_max(other) )
+                {
+                    remove(pairs, body(e), body(other));
+                }
+
+                endpoints[j] = other;
+            }
+
+            endpoints[j] = e;
+        }
+    }
+
+private:
+    struct Endpoint
+    {
+        float    value;
+        /** body << 1 | 1 for the interval end */
+        uint32_t id;
+    };
+
+    static inline uint32_t body(const Endpoint& e) { return e.id >> 1; }
+    static inline bool     is_max(const Endpoint& e) { return 0 != (e.id & 1); }
+
+    /** starts sort before ends at equal values, so touching spheres overlap */
+    static inline bool less(const Endpoint& a, const Endpoint& b)
+    {
+        return a.value < b.value || (a.value == b.value && !is_max(a) && is_max(b));
+    }
+
+    static inline float value(const BodyStore& bodies, uint32_t id)
+    {
+        float lower, upper;
+        swept_bounds(bodies, bodies.origin, bodies.lastPosition, id >> 1, 0, lower, upper);
+        return (id & 1) ? upper : lower;
+    }
+
+    inline void rebuild(const BodyStore& bodies, std::vector<CollisionPair>& pairs)
+    {
+        endpoints.resize(2 * bodies.count);
+        for ( size_t i = 0; i < endpoints.size(); i++ )
+        {
+            endpoints[i].id    = (uint32_t)i;
+            endpoints[i].value = value(bodies, endpoints[i].id);
+        }
+        std::sort(endpoints.begin(), endpoints.end(), less);
+
+        overlaps.clear();
+        pairs.clear();
+
+        /* every body open at a start overlaps the starting one */
+        open.clear();
+        for ( size_t i = 0; i < endpoints.size(); i++ )
+        {
+            uint32_t b = body(endpoints[i]);
+
+            if ( is_max(endpoints[i]) )
+            {
+                open.erase(std::find(open.begin(), open.end(), b));
+            }
+            else
+            {
+                for ( size_t j = 0; j < open.size(); j++ )
+                {
+                    add(pairs, open[j], b);
+                }
+                open.push_back(b);
+            }
+        }
+    }
+
+    inline void add(std::vector<CollisionPair>& pairs, uint32_t a, uint32_t b)
+    {
+        if ( a > b ) std::swap(a, b);
+
+        CollisionPair p = CollisionPair();
+        p.bodyA = a;
+        p.bodyB = b;
+
+        overlaps.insert(IndexMap::pair_key(a, b), (uint32_t)pairs.size());
+        pairs.push_back(p);
+    }
+
+    inline void remove(std::vector<CollisionPair>& pairs, uint32_t a, uint32_t b)
+    {
+        uint64_t k = IndexMap::pair_key(a, b);
+        uint32_t index = *overlaps.find(k);
+        overlaps.remove(k);
+
+        /* swap-erase, the last pair takes over the slot */
+        if ( index + 1 != pairs.size() )
+        {
+            pairs[index] = pairs.back();
+            *overlaps.find(IndexMap::pair_key(pairs[index].bodyA, pairs[index].bodyB)) = index;
+        }
+        pairs.pop_back();
+    }
+
+    std::vector<Endpoint> endpoints;
+    IndexMap overlaps;
+
+    /** scratch for rebuild() */
+    std::vector<uint32_t> open;
+};
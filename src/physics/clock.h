@@ -0,0 +1,73 @@
+/*
+ * Copyright (c) 2015 Jonathan Howard
+ * License: https://github.com/v3n/altertum/blob/master/LICENSE
+ */
+
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+
+/** simulation time units per wall-clock second (see toS in main.cpp) */
+static const float g_timeScale = 10.0f;
+/** physics step size, 120 Hz in wall-clock time */
+static const float g_fixedDeltaTime = g_timeScale / 120.0f;
+/** most physics steps run for a single rendered frame */
+static const size_t g_maxSubsteps = 8;
+
+/**
+ * @file clock.h
+ * Fixed-timestep accumulator decoupling physics rate from frame rate
+ */
+struct FixedTimestep
+{
+    float  deltaTime;
+    float  accumulator;
+    size_t maxSubsteps;
+
+    inline void init(float _deltaTime = g_fixedDeltaTime, size_t _maxSubsteps = g_maxSubsteps)
+    {
+        deltaTime   = _deltaTime;
+        accumulator = 0.0f;
+        maxSubsteps = _maxSubsteps;
+    }
+
+    inline void reset()
+    {
+        accumulator = 0.0f;
+    }
+
+    /**
+     * Accumulate a frame's worth of time
+     * @param frameTime elapsed simulation time since the last frame
+     * @return number of fixed steps to run this frame, at most maxSubsteps
+     */
+    inline size_t advance(float frameTime)
+    {
+        if ( frameTime > 0.0f )
+        {
+            accumulator += frameTime;
+        }
+
+        size_t steps = 0;
+        while ( accumulator >= deltaTime && steps < maxSubsteps )
+        {
+            accumulator -= deltaTime;
+            steps++;
+        }
+
+        /* drop the backlog after a stall instead of chasing it */
+        if ( accumulator >= deltaTime )
+        {
+            accumulator = fmodf(accumulator, deltaTime);
+        }
+
+        return steps;
+    }
+
+    /** Fraction of a step left in the accumulator, for render interpolation. */
+    inline float alpha() const
+    {
+        return accumulator / deltaTime;
+    }
+};
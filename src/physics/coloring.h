@@ -0,0 +1,118 @@
+/*
+ * Copyright (c) 2015 Jonathan Howard
+ * License: https://github.com/v3n/altertum/blob/master/LICENSE
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "physics/resolver.h"
+
+/**
+ * @file coloring.h
+ * Greedy graph coloring of contact pairs
+ * Pairs of one color share no body, so a whole batch can be resolved in
+ * parallel. A single row of pendulums colors into even and odd pairs.
+ */
+struct ContactColoring
+{
+    /** colors tracked per body, pairs beyond this go to a serial batch */
+    static const uint32_t max_colors = 64;
+
+    /** pair indices grouped by color, in pair order within a color */
+    std::vector<uint32_t> order;
+    /** batch c is order[offsets[c], offsets[c + 1]) */
+    std::vector<uint32_t> offsets;
+    /** true if the last batch is the serial overflow batch */
+    bool overflow;
+
+    ContactColoring()
+        : overflow(false)
+    {
+    }
+
+    /** Number of batches, including the overflow batch. */
+    inline size_t batch_count() const
+    {
+        return offsets.empty() ? 0 : offsets.size() - 1;
+    }
+
+    /** Make room for @a n_pairs pairs between @a n_bodies bodies. */
+    inline void reserve(size_t n_pairs, size_t n_bodies)
+    {
+        order.reserve(n_pairs);
+        offsets.reserve(max_colors + 2);
+        body_colors.reserve(n_bodies);
+        pair_colors.reserve(n_pairs);
+        cursor.reserve(max_colors + 2);
+    }
+
+    /** Partition @a pairs between @a n_bodies bodies into color batches. */
+    inline void build(const std::vector<CollisionPair>& pairs, size_t n_bodies)
+    {
+        body_colors.assign(n_bodies, 0);
+        pair_colors.resize(pairs.size());
+
+        uint32_t n_colors = 0;
+        overflow = false;
+
+        for ( size_t i = 0; i < pairs.size(); i++ )
+        {
+            uint32_t a = pairs[i].bodyA;
+            uint32_t b = pairs[i].bodyB;
+            uint64_t used = body_colors[a] | body_colors[b];
+
+            uint32_t color = max_colors;
+            for ( uint32_t c = 0; c < max_colors; c++ )
+            {
+                if ( 0 == (used & (uint64_t(1) << c)) )
+                {
+                    color = c;
+                    break;
+                }
+            }
+
+            if ( color < max_colors )
+            {
+                body_colors[a] |= uint64_t(1) << color;
+                body_colors[b] |= uint64_t(1) << color;
+                if ( color + 1 > n_colors ) n_colors = color + 1;
+            }
+            else
+            {
+                overflow = true;
+            }
+
+            pair_colors[i] = color;
+        }
+
+        size_t n_batches = n_colors + (overflow ? 1 : 0);
+
+        /* counting sort keeps pair order within each color */
+        offsets.assign(n_batches + 1, 0);
+        for ( size_t i = 0; i < pairs.size(); i++ )
+        {
+            uint32_t batch = pair_colors[i] < max_colors ? pair_colors[i] : n_colors;
+            offsets[batch + 1]++;
+        }
+        for ( size_t c = 0; c < n_batches; c++ )
+        {
+            offsets[c + 1] += offsets[c];
+        }
+
+        order.resize(pairs.size());
+        cursor.assign(offsets.begin(), offsets.end());
+        for ( size_t i = 0; i < pairs.size(); i++ )
+        {
+            uint32_t batch = pair_colors[i] < max_colors ? pair_colors[i] : n_colors;
+            order[cursor[batch]++] = (uint32_t)i;
+        }
+    }
+
+private:
+    std::vector<uint64_t> body_colors;
+    std::vector<uint32_t> pair_colors;
+    std::vector<uint32_t> cursor;
+};
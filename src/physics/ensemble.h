@@ -0,0 +1,230 @@
+/*
+ * Copyright (c) 2015 Jonathan Howard
+ * License: https://github.com/v3n/altertum/blob/master/LICENSE
+ */
+
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "physics/body_store.h"
+#include "physics/simulation.h"
+
+/** room left between the spheres of neighboring cradles */
+static const float g_ensembleGap = 1.0f;
+
+/** One cradle of an ensemble */
+struct CradleSpec
+{
+    uint32_t balls;
+    /** raised bodies on the left and right side, as in Simulation::set_starting_angles() */
+    uint32_t left;
+    uint32_t right;
+
+    float mass;
+    float radius;
+    float length;
+    float degrees;
+};
+
+/** What a cradle of an ensemble did over a run */
+struct CradleStats
+{
+    double startEnergy;
+    double endEnergy;
+
+    /** largest swing of the leftmost and rightmost bodies, in degrees */
+    float peakFirst;
+    float peakLast;
+
+    /**
+     * Step the end body across from the raised side first swung out half
+     * the starting angle; 0 if it has not, or both sides were raised
+     */
+    uint32_t transferStep;
+    /** bodies not asleep at the end */
+    uint32_t awake;
+};
+
+/**
+ * @file ensemble.h
+ * Many independent cradles stepped as one Simulation
+ * Every cradle gets its own ball count, mass, radius, string length and
+ * starting angles, and all of them are packed into one BodyStore, so each
+ * step runs the SIMD kernels and jobs across every cradle at once and
+ * cradles that come to rest fall asleep on their own. Every cradle hangs
+ * from the same x and y, in a plane of its own along z; the swing and the
+ * contacts only see z as a difference between bodies, which is exactly 0
+ * inside a cradle, so a cradle steps the same in any plane. Planes are
+ * further apart than any two spheres can reach, so cradles never touch.
+ * All cradles share one x interval, so the grid broadphase is used.
+ */
+struct Ensemble
+{
+    std::vector<CradleSpec> specs;
+    /** first body of each cradle, and the body count last */
+    std::vector<uint32_t> first;
+    std::vector<CradleStats> stats;
+
+    /** Build every cradle of specs in @a simulation, raised and at rest. */
+    inline void create(Simulation& simulation, float deltaTime)
+    {
+        size_t n_cradles = specs.size();
+
+        first.resize(n_cradles + 1);
+
+        float max_radius = 0.0f;
+        size_t n_bodies = 0;
+        for ( size_t c = 0; c < n_cradles; c++ )
+        {
+            first[c] = (uint32_t)n_bodies;
+            n_bodies += specs[c].balls;
+            if ( specs[c].radius > max_radius ) max_radius = specs[c].radius;
+        }
+        first[n_cradles] = (uint32_t)n_bodies;
+
+        float pitch = 2.0f * max_radius + g_ensembleGap;
+
+        simulation.broadphaseType = BroadphaseType::Grid;
+
+        size_t c = 0;
+        simulation.build_bodies(n_bodies, max_radius, [&](BodyStore& bodies, size_t i)
+        {
+            while ( i >= first[c + 1] ) c++;
+
+            /* neighbors in a cradle just touch while hanging */
+            const CradleSpec& spec = specs[c];
+            float offset = 2.0f * spec.radius * (i - first[c]);
+            bodies.init_body(i,
+                            vector3::vector3(offset, 0.0f, pitch * c),
+                            spec.mass,
+                            0.0f,
+                            spec.radius,
+                            spec.length
+                        );
+        });
+
+        BodyStore& bodies = simulation.bodies;
+        for ( c = 0; c < n_cradles; c++ )
+        {
+            const CradleSpec& spec = specs[c];
+            uint32_t left  = spec.left  < spec.balls ? spec.left  : spec.balls;
+            uint32_t right = spec.right < spec.balls ? spec.right : spec.balls;
+
+            for ( uint32_t i = 0; i < left; i++ )
+            {
+                bodies.angle[first[c] + i] = spec.degrees;
+            }
+            for ( uint32_t i = 0; i < right; i++ )
+            {
+                bodies.angle[first[c + 1] - 1 - i] = -spec.degrees;
+            }
+        }
+        for ( size_t i = 0; i < n_bodies; i++ )
+        {
+            bodies.lastAngle[i] = bodies.angle[i];
+        }
+        simulation.hang();
+
+        stats.resize(n_cradles);
+        for ( c = 0; c < n_cradles; c++ )
+        {
+            CradleStats& s = stats[c];
+            s.startEnergy  = body_store::energy(bodies, first[c], first[c + 1], deltaTime);
+            s.endEnergy    = s.startEnergy;
+            s.peakFirst    = 0.0f;
+            s.peakLast     = 0.0f;
+            s.transferStep = 0;
+            s.awake        = first[c + 1] - first[c];
+        }
+        sample(simulation, 0);
+    }
+
+    /** Fold step @a step of @a simulation into the stats, touching two bodies a cradle. */
+    inline void sample(const Simulation& simulation, uint32_t step)
+    {
+        const BodyStore& bodies = simulation.bodies;
+
+        for ( size_t c = 0; c < specs.size(); c++ )
+        {
+            if ( first[c] == first[c + 1] ) continue;
+
+            const CradleSpec& spec = specs[c];
+            CradleStats& s = stats[c];
+
+            float a_first = fabsf(bodies.angle[first[c]]);
+            float a_last  = fabsf(bodies.angle[first[c + 1] - 1]);
+            if ( a_first > s.peakFirst ) s.peakFirst = a_first;
+            if ( a_last  > s.peakLast  ) s.peakLast  = a_last;
+
+            bool raised_left  = spec.left  > 0;
+            bool raised_right = spec.right > 0;
+            if ( 0 == s.transferStep && step > 0 && raised_left != raised_right )
+            {
+                float across = raised_left ? a_last : a_first;
+                if ( across >= 0.5f * fabsf(spec.degrees) ) s.transferStep = step;
+            }
+        }
+    }
+
+    /** Take the end of run stats from @a simulation. */
+    inline void finish(const Simulation& simulation, float deltaTime)
+    {
+        const BodyStore& bodies = simulation.bodies;
+
+        for ( size_t c = 0; c < specs.size(); c++ )
+        {
+            CradleStats& s = stats[c];
+            s.endEnergy = body_store::energy(bodies, first[c], first[c + 1], deltaTime);
+
+            s.awake = 0;
+            for ( uint32_t i = first[c]; i < first[c + 1]; i++ )
+            {
+                if ( !bodies.sleeping[i] ) s.awake++;
+            }
+        }
+    }
+
+    /**
+     * Cradles whose stats differ from those of the first cradle of the same
+     * spec; 0 unless where a cradle hangs changed how it stepped.
+     */
+    inline size_t mismatched() const
+    {
+        std::vector<size_t> distinct;
+
+        size_t n_mismatched = 0;
+        for ( size_t c = 0; c < specs.size(); c++ )
+        {
+            size_t d = 0;
+            while ( d < distinct.size() && !same_spec(specs[distinct[d]], specs[c]) ) d++;
+
+            if ( d == distinct.size() )
+            {
+                distinct.push_back(c);
+            }
+            else if ( !same_stats(stats[distinct[d]], stats[c]) )
+            {
+                n_mismatched++;
+            }
+        }
+        return n_mismatched;
+    }
+
+private:
+    static inline bool same_spec(const CradleSpec& a, const CradleSpec& b)
+    {
+        return a.balls == b.balls && a.left == b.left && a.right == b.right
+            && a.mass == b.mass && a.radius == b.radius && a.length == b.length
+            && a.degrees == b.degrees;
+    }
+
+    static inline bool same_stats(const CradleStats& a, const CradleStats& b)
+    {
+        return a.startEnergy == b.startEnergy && a.endEnergy == b.endEnergy
+            && a.peakFirst == b.peakFirst && a.peakLast == b.peakLast
+            && a.transferStep == b.transferStep && a.awake == b.awake;
+    }
+};
@@ -5,6 +5,8 @@
 
 #pragma once
 
+#include <cmath>
+
 #include "math/math_types.h"
 #include "math/vector3.h"
 
@@ -15,20 +17,77 @@ inline float clamp(float x, float a, float b)
     return x < a ? a : (x > b ? b : x);
 }
 
+/** Contact between two shapes, normal points from the first to the second. */
+struct Collision
+{
+    /** overlap depth, positive when touching */
+    float penetration;
+    Vector3 normal;
+    /** normal turned a quarter turn in the swing (xy) plane */
+    Vector3 tangent;
+};
+
+/** distances below this are treated as coincident centers */
+static const float g_contactEpsilon = 1e-6f;
+
+/**
+ * Fill @a c for two spheres whose centers are @a d apart
+ * @return true if the spheres overlap
+ * Shared by every narrowphase test and mirrored by the batched kernels,
+ * keep the operation order in sync with kernels_simd.inl.
+ */
+inline bool sphere_contact(const Vector3& d, float radius, Collision& c)
+{
+    float distance_sq = d.x * d.x + d.y * d.y + d.z * d.z;
+    float distance = sqrtf(distance_sq);
+
+    if ( distance > g_contactEpsilon )
+    {
+        c.normal = vector3::vector3(d.x / distance, d.y / distance, d.z / distance);
+    }
+    else
+    {
+        /* coincident centers, push apart along the cradle */
+        c.normal = vector3::vector3(1.0f, 0.0f, 0.0f);
+    }
+
+    float planar = sqrtf(c.normal.x * c.normal.x + c.normal.y * c.normal.y);
+    if ( planar > g_contactEpsilon )
+    {
+        c.tangent = vector3::vector3(-c.normal.y / planar, c.normal.x / planar, 0.0f);
+    }
+    else
+    {
+        c.tangent = vector3::vector3(0.0f, 1.0f, 0.0f);
+    }
+
+    c.penetration = radius - distance;
+
+    return distance_sq <= radius * radius;
+}
+
 struct BoundingSphere
 {
     Vector3 origin;
     float radius;
 
-    inline bool check_collision(BoundingSphere& s2)
+    inline bool check_collision(const BoundingSphere& s2) const
     {
-        BoundingSphere s1 = *this;
+        Vector3 pos = origin - s2.origin;
+        float distance_sq = pos.x * pos.x + pos.y * pos.y + pos.z * pos.z;
+        float min_dist = radius + s2.radius;
 
-        Vector3 pos = s1.origin - s2.origin;
-        float distance_sq = pos.x * pos.x; // + pos.y * pos.y;
-        float min_dist_sq = s1.radius + s2.radius;
+        return distance_sq <= (min_dist * min_dist);
+    }
 
-        return distance_sq <= (min_dist_sq * min_dist_sq);
+    /**
+     * Sphere-sphere test
+     * @param c contact with the normal pointing towards @a s2
+     * @return true if the spheres overlap
+     */
+    inline bool collide(const BoundingSphere& s2, Collision& c) const
+    {
+        return sphere_contact(s2.origin - origin, radius + s2.radius, c);
     }
 
     inline void update(Vector3 vel)
@@ -225,7 +284,7 @@ struct PhysicsBody
 
         /* track speed and acceleration */
         speed = vector3::distance(velocity);
-        angularSpeed = abs(angularVelocity);
+        angularSpeed = fabsf(angularVelocity);
     }
 
     inline void clearForces()
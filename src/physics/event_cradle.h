@@ -0,0 +1,354 @@
+/*
+ * Copyright (c) 2015 Jonathan Howard
+ * License: https://github.com/v3n/altertum/blob/master/LICENSE
+ */
+
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include "physics/body_store.h"
+#include "physics/pendulum.h"
+
+/** bobs closer than this are in contact */
+static const double g_eventContactGap = 1e-9;
+/** contacts closing slower than this are resting, not impacts */
+static const double g_eventMinClosing = 1e-12;
+/** swings this close in angle and, relative to their top rate, in rate move together */
+static const double g_eventSameSwing = 1e-9;
+/** conservative advancement steps per prediction before it is resumed by a recheck */
+static const size_t g_eventMaxAdvances = 256;
+
+/**
+ * @file event_cradle.h
+ * Event-driven cradle, exact between impacts
+ * Every pendulum follows its closed-form swing (see pendulum.h), so the
+ * only events are impacts between neighboring bobs swinging in the same
+ * plane. Each neighbor pair holds its next impact in a priority queue;
+ * the earliest is taken, impulses are exchanged along the contact normal,
+ * and the pairs around it are predicted again. Impacts of a touching row
+ * follow each other at the same instant, which passes the strike along
+ * the row.
+ * Air friction is not modelled, so the energy only changes by rounding.
+ */
+struct EventCradle
+{
+    /** simulation time reached */
+    double time;
+    /** impacts since reset */
+    uint64_t impacts;
+
+    EventCradle()
+        : time(0.0)
+        , impacts(0)
+    {
+    }
+
+    /**
+     * Take the pendulums of @a bodies as they are, at time zero
+     * Rates come from the last step, angle - lastAngle over @a deltaTime.
+     */
+    inline void reset(const BodyStore& bodies, float deltaTime)
+    {
+        const double to_radians = M_PI / 180;
+
+        size_t n = bodies.count;
+        size_t n_pairs = n > 1 ? n - 1 : 0;
+
+        time = 0.0;
+        impacts = 0;
+
+        swings.resize(n);
+        pivot_x.resize(n);
+        pivot_y.resize(n);
+        pivot_z.resize(n);
+        length.resize(n);
+        radius.resize(n);
+        mass.resize(n);
+
+        for ( size_t i = 0; i < n; i++ )
+        {
+            pivot_x[i] = bodies.constraintLoc.x[i];
+            pivot_y[i] = bodies.constraintLoc.y[i];
+            pivot_z[i] = bodies.constraintLoc.z[i];
+            length[i]  = bodies.constraintLen[i];
+            radius[i]  = bodies.radius[i];
+            mass[i]    = bodies.mass[i];
+
+            double angle = bodies.angle[i] * to_radians;
+            double rate  = (bodies.angle[i] - bodies.lastAngle[i]) * to_radians / deltaTime;
+            swings[i].set(angle, rate, sqrt(BodyStore::gravity / length[i]), time);
+        }
+
+        event_time.resize(n_pairs);
+        event_impact.resize(n_pairs);
+        heap.resize(n_pairs);
+        heap_index.resize(n_pairs);
+
+        for ( size_t p = 0; p < n_pairs; p++ )
+        {
+            predict((uint32_t)p);
+            heap[p] = (uint32_t)p;
+            heap_index[p] = (uint32_t)p;
+        }
+        for ( size_t i = n_pairs / 2; i-- > 0; )
+        {
+            sift_down(i);
+        }
+    }
+
+    /** Run every event up to @a deltaTime from now. */
+    inline void advance(float deltaTime)
+    {
+        double target = time + deltaTime;
+
+        while ( !heap.empty() && event_time[heap[0]] <= target )
+        {
+            uint32_t p = heap[0];
+            time = event_time[p];
+
+            if ( event_impact[p] && impact(p) )
+            {
+                if ( p > 0 ) repredict(p - 1);
+                repredict(p);
+                if ( p + 1 < heap.size() ) repredict(p + 1);
+            }
+            else
+            {
+                repredict(p);
+            }
+        }
+
+        time = target;
+    }
+
+    /**
+     * Write the pendulums [begin, end) at the current time into @a bodies
+     * Last angles and positions keep what the previous call wrote, so
+     * angle - lastAngle is the motion over the step as with the stepped
+     * engine. Spheres are left for the constraint kernel to place.
+     */
+    inline void sample(BodyStore& bodies, size_t begin, size_t end) const
+    {
+        const double to_degrees = 180 / M_PI;
+
+        for ( size_t i = begin; i < end; i++ )
+        {
+            double angle, rate;
+            swings[i].at(time, angle, rate);
+
+            bodies.lastPosition.set(i, bodies.position.get(i));
+            bodies.lastAngle[i] = bodies.angle[i];
+            bodies.angle[i] = float(angle * to_degrees);
+
+            bodies.angularVelocity[i] = bodies.angle[i] - bodies.lastAngle[i];
+            bodies.angularSpeed[i] = fabsf(bodies.angularVelocity[i]);
+        }
+    }
+
+    /** Total energy of the pendulums, kinetic plus potential above the bottom. */
+    inline double energy() const
+    {
+        double total = 0.0;
+        for ( size_t i = 0; i < swings.size(); i++ )
+        {
+            /* 1 - cos(amplitude) = 2 k^2 */
+            total += 2 * mass[i] * BodyStore::gravity * length[i] * swings[i].k * swings[i].k;
+        }
+        return total;
+    }
+
+private:
+    /** Bob position and velocity of pendulum @a i at time @a t. */
+    inline void bob(uint32_t i, double t, double& x, double& y, double& vx, double& vy) const
+    {
+        double angle, rate;
+        swings[i].at(t, angle, rate);
+
+        double s = sin(angle);
+        double c = cos(angle);
+
+        x  = pivot_x[i] - length[i] * s;
+        y  = pivot_y[i] - length[i] * c;
+        vx = -length[i] * c * rate;
+        vy =  length[i] * s * rate;
+    }
+
+    /** Gap between the bobs of pair @a p at time @a t, and how fast it closes. */
+    inline double gap(uint32_t p, double t, double& closing) const
+    {
+        double xa, ya, vxa, vya;
+        double xb, yb, vxb, vyb;
+        bob(p,     t, xa, ya, vxa, vya);
+        bob(p + 1, t, xb, yb, vxb, vyb);
+
+        double dx = xb - xa;
+        double dy = yb - ya;
+        double distance = sqrt(dx * dx + dy * dy);
+
+        closing = distance > 0 ? ((vxa - vxb) * dx + (vya - vyb) * dy) / distance : 0.0;
+        return distance - (radius[p] + radius[p + 1]);
+    }
+
+    /**
+     * Find the next impact of pair @a p from now
+     * Conservative advancement: the gap shrinks no faster than both bobs'
+     * top speeds together, so stepping by gap over that never passes an
+     * impact. Pairs that do not meet within a swing are checked again then.
+     * Bobs swinging together keep their gap until one of them is struck,
+     * which predicts the pair again, so they get no event.
+     */
+    inline void predict(uint32_t p)
+    {
+        const Swing& a = swings[p];
+        const Swing& b = swings[p + 1];
+
+        event_time[p] = std::numeric_limits<double>::infinity();
+        event_impact[p] = 0;
+
+        double bound = a.max_rate() * length[p] + b.max_rate() * length[p + 1];
+        if ( bound <= 0 || apart(p) || same_swing(p) ) return;
+
+        double limit = time + fmin(a.period(), b.period());
+        double t = time;
+
+        for ( size_t i = 0; i < g_eventMaxAdvances; i++ )
+        {
+            double closing;
+            double g = gap(p, t, closing);
+
+            if ( g <= g_eventContactGap && closing > g_eventMinClosing )
+            {
+                event_time[p] = t;
+                event_impact[p] = 1;
+                return;
+            }
+
+            /* touching bobs moving apart step out of contact */
+            t += fmax(g, g_eventContactGap) / bound;
+            if ( t > limit ) break;
+        }
+
+        event_time[p] = fmin(t, limit);
+    }
+
+    /** True if the bobs of pair @a p swing in planes too far apart to touch. */
+    inline bool apart(uint32_t p) const
+    {
+        return fabs(pivot_z[p + 1] - pivot_z[p]) >= radius[p] + radius[p + 1];
+    }
+
+    /** True if the pendulums of pair @a p swing as one from now on. */
+    inline bool same_swing(uint32_t p) const
+    {
+        const Swing& a = swings[p];
+        const Swing& b = swings[p + 1];
+
+        if ( a.w != b.w ) return false;
+
+        double angle_a, rate_a, angle_b, rate_b;
+        a.at(time, angle_a, rate_a);
+        b.at(time, angle_b, rate_b);
+
+        double tolerance = g_eventSameSwing * fmax(1.0, fmax(a.max_rate(), b.max_rate()));
+        return fabs(angle_a - angle_b) <= g_eventSameSwing && fabs(rate_a - rate_b) <= tolerance;
+    }
+
+    /** Exchange impulses between the bobs of pair @a p, returns false if they no longer close. */
+    inline bool impact(uint32_t p)
+    {
+        uint32_t a = p;
+        uint32_t b = p + 1;
+
+        double angle_a, rate_a, angle_b, rate_b;
+        swings[a].at(time, angle_a, rate_a);
+        swings[b].at(time, angle_b, rate_b);
+
+        double dx = (pivot_x[b] - length[b] * sin(angle_b)) - (pivot_x[a] - length[a] * sin(angle_a));
+        double dy = (pivot_y[b] - length[b] * cos(angle_b)) - (pivot_y[a] - length[a] * cos(angle_a));
+        double distance = sqrt(dx * dx + dy * dy);
+        if ( distance <= 0 ) return false;
+
+        /* bob velocity along the normal per unit rate */
+        double n_a = length[a] * (-cos(angle_a) * dx + sin(angle_a) * dy) / distance;
+        double n_b = length[b] * (-cos(angle_b) * dx + sin(angle_b) * dy) / distance;
+
+        double closing = n_a * rate_a - n_b * rate_b;
+        if ( closing <= g_eventMinClosing ) return false;
+
+        double inertia_a = mass[a] * length[a] * length[a];
+        double inertia_b = mass[b] * length[b] * length[b];
+        double impulse = (1 + BodyStore::restitution) * closing / (n_a * n_a / inertia_a + n_b * n_b / inertia_b);
+
+        swings[a].set(angle_a, rate_a - impulse * n_a / inertia_a, swings[a].w, time);
+        swings[b].set(angle_b, rate_b + impulse * n_b / inertia_b, swings[b].w, time);
+
+        impacts++;
+        return true;
+    }
+
+    inline void repredict(uint32_t p)
+    {
+        predict(p);
+        sift_up(heap_index[p]);
+        sift_down(heap_index[p]);
+    }
+
+    /** Heap order: earliest event first, lower pair first on ties. */
+    inline bool earlier(uint32_t p, uint32_t q) const
+    {
+        return event_time[p] < event_time[q] || (event_time[p] == event_time[q] && p < q);
+    }
+
+    inline void swap_slots(size_t i, size_t j)
+    {
+        std::swap(heap[i], heap[j]);
+        heap_index[heap[i]] = (uint32_t)i;
+        heap_index[heap[j]] = (uint32_t)j;
+    }
+
+    inline void sift_up(size_t i)
+    {
+        while ( i > 0 && earlier(heap[i], heap[(i - 1) / 2]) )
+        {
+            swap_slots(i, (i - 1) / 2);
+            i = (i - 1) / 2;
+        }
+    }
+
+    inline void sift_down(size_t i)
+    {
+        for ( ;; )
+        {
+            size_t first = i;
+            size_t left = 2 * i + 1;
+            size_t right = left + 1;
+
+            if ( left  < heap.size() && earlier(heap[left],  heap[first]) ) first = left;
+            if ( right < heap.size() && earlier(heap[right], heap[first]) ) first = right;
+            if ( first == i ) return;
+
+            swap_slots(i, first);
+            i = first;
+        }
+    }
+
+    std::vector<Swing>  swings;
+    std::vector<double> pivot_x;
+    std::vector<double> pivot_y;
+    std::vector<double> pivot_z;
+    std::vector<double> length;
+    std::vector<double> radius;
+    std::vector<double> mass;
+
+    /** next event of each neighbor pair (i, i + 1), an impact or a recheck */
+    std::vector<double>  event_time;
+    std::vector<uint8_t> event_impact;
+
+    /** pairs as a binary min-heap on event time, and each pair's slot in it */
+    std::vector<uint32_t> heap;
+    std::vector<uint32_t> heap_index;
+};
@@ -0,0 +1,164 @@
+/*
+ * Copyright (c) 2015 Jonathan Howard
+ * License: https://github.com/v3n/altertum/blob/master/LICENSE
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "physics/resolver.h"
+
+/**
+ * @file islands.h
+ * Contact islands, groups of bodies linked by touching pairs
+ * Built each step with union-find over the touching pairs. Islands share
+ * no body, so each one is solved on its own and islands run in parallel.
+ * Only bodies that touch something are visited, so the cost follows the
+ * contacts rather than the bodies.
+ */
+struct ContactIslands
+{
+    /** touching pair indices grouped by island, in pair order within an island */
+    std::vector<uint32_t> order;
+    /** island k is order[offsets[k], offsets[k + 1]) */
+    std::vector<uint32_t> offsets;
+
+    ContactIslands()
+        : epoch(0)
+    {
+    }
+
+    /** Number of islands. */
+    inline size_t island_count() const
+    {
+        return offsets.empty() ? 0 : offsets.size() - 1;
+    }
+
+    /** True if body @a b touched something in the last build. */
+    inline bool contains(uint32_t b) const
+    {
+        return b < stamp.size() && stamp[b] == epoch;
+    }
+
+    /** Make room for @a n_pairs pairs between @a n_bodies bodies. */
+    inline void reserve(size_t n_pairs, size_t n_bodies)
+    {
+        order.reserve(n_pairs);
+        offsets.reserve(n_pairs + 1);
+        pair_island.reserve(n_pairs);
+        cursor.reserve(n_pairs + 1);
+
+        if ( parent.size() < n_bodies )
+        {
+            parent.resize(n_bodies);
+            rank.resize(n_bodies);
+            label.resize(n_bodies);
+            stamp.resize(n_bodies, 0);
+        }
+    }
+
+    /**
+     * Group the pairs of @a pairs with @a touching set into islands
+     * Islands are numbered in order of their first pair.
+     */
+    inline void build(const std::vector<CollisionPair>& pairs, const uint8_t* touching, size_t n_bodies)
+    {
+        reserve(pairs.size(), n_bodies);
+
+        /* a new epoch marks every body unvisited without touching them */
+        if ( 0 == ++epoch )
+        {
+            std::fill(stamp.begin(), stamp.end(), 0);
+            epoch = 1;
+        }
+
+        for ( size_t i = 0; i < pairs.size(); i++ )
+        {
+            if ( touching[i] ) link(visit(pairs[i].bodyA), visit(pairs[i].bodyB));
+        }
+
+        uint32_t n_islands = 0;
+        pair_island.resize(pairs.size());
+        offsets.assign(1, 0);
+
+        for ( size_t i = 0; i < pairs.size(); i++ )
+        {
+            if ( !touching[i] ) continue;
+
+            uint32_t root = find(pairs[i].bodyA);
+            if ( c_none == label[root] )
+            {
+                label[root] = n_islands++;
+                offsets.push_back(0);
+            }
+
+            pair_island[i] = label[root];
+            offsets[label[root] + 1]++;
+        }
+
+        /* counting sort keeps pair order within each island */
+        for ( size_t k = 0; k < n_islands; k++ )
+        {
+            offsets[k + 1] += offsets[k];
+        }
+
+        order.resize(offsets[n_islands]);
+        cursor.assign(offsets.begin(), offsets.end());
+        for ( size_t i = 0; i < pairs.size(); i++ )
+        {
+            if ( touching[i] ) order[cursor[pair_island[i]]++] = (uint32_t)i;
+        }
+    }
+
+private:
+    static const uint32_t c_none = 0xffffffff;
+
+    /** Body @a b, made its own set the first time it is seen this epoch. */
+    inline uint32_t visit(uint32_t b)
+    {
+        if ( stamp[b] != epoch )
+        {
+            stamp[b]  = epoch;
+            parent[b] = b;
+            rank[b]   = 0;
+            label[b]  = c_none;
+        }
+        return b;
+    }
+
+    /** Root of the set of visited body @a b, halving the path on the way. */
+    inline uint32_t find(uint32_t b)
+    {
+        while ( parent[b] != b )
+        {
+            parent[b] = parent[parent[b]];
+            b = parent[b];
+        }
+        return b;
+    }
+
+    /** Merge the sets of @a a and @a b, by rank. */
+    inline void link(uint32_t a, uint32_t b)
+    {
+        a = find(a);
+        b = find(b);
+        if ( a == b ) return;
+
+        if ( rank[a] < rank[b] ) std::swap(a, b);
+        parent[b] = a;
+        if ( rank[a] == rank[b] ) rank[a]++;
+    }
+
+    /** union-find state, valid for bodies whose stamp is the current epoch */
+    std::vector<uint32_t> parent;
+    std::vector<uint32_t> rank;
+    std::vector<uint32_t> label;
+    std::vector<uint32_t> stamp;
+    uint32_t              epoch;
+
+    std::vector<uint32_t> pair_island;
+    std::vector<uint32_t> cursor;
+};
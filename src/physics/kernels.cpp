@@ -0,0 +1,310 @@
+/*
+ * Copyright (c) 2015 Jonathan Howard
+ * License: https://github.com/v3n/altertum/blob/master/LICENSE
+ */
+
+#include <cstring>
+
+#include "physics/kernels.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#   define CRADLE_SIMD_X86 1
+#   include <immintrin.h>
+#   if defined(_MSC_VER)
+#       include <intrin.h>
+#   endif
+#else
+#   define CRADLE_SIMD_X86 0
+#endif
+
+/**
+ * Compile the enclosed functions for a specific instruction set without
+ * raising the baseline of the whole binary. MSVC needs no switch to emit
+ * intrinsics. FP contraction is switched off (AVX-512F implies FMA) so the
+ * compiler cannot fuse mul+add pairs and break bit agreement with the
+ * scalar path.
+ */
+#if defined(__clang__)
+#   define CRADLE_TARGET_BEGIN(_isa) _Pragma(_isa)
+#   define CRADLE_TARGET_END         _Pragma("clang attribute pop")
+#   define CRADLE_PRAGMA_AVX2        "clang attribute push (__attribute__((target(\"avx2\"))), apply_to = function)"
+#   define CRADLE_PRAGMA_AVX512      "clang attribute push (__attribute__((target(\"avx512f\"))), apply_to = function)"
+#elif defined(__GNUC__)
+#   define CRADLE_TARGET_BEGIN(_isa) _Pragma("GCC push_options") _Pragma(_isa) _Pragma("GCC optimize(\"fp-contract=off\")")
+#   define CRADLE_TARGET_END         _Pragma("GCC pop_options")
+#   define CRADLE_PRAGMA_AVX2        "GCC target(\"avx2\")"
+#   define CRADLE_PRAGMA_AVX512      "GCC target(\"avx512f\")"
+#else
+#   define CRADLE_TARGET_BEGIN(_isa)
+#   define CRADLE_TARGET_END
+#endif
+
+#if CRADLE_SIMD_X86
+
+/* SSE2 is part of the x86-64 baseline, 4 lanes */
+namespace simd_sse2
+{
+
+typedef __m128  vfloat;
+typedef __m128i vint;
+typedef __m128  vmask;
+
+static const size_t c_lanes = 4;
+
+inline vfloat v_load(const float* p)         { return _mm_loadu_ps(p); }
+inline void   v_store(float* p, vfloat v)    { _mm_storeu_ps(p, v); }
+inline vfloat v_set1(float f)                { return _mm_set1_ps(f); }
+inline vfloat v_add(vfloat a, vfloat b)      { return _mm_add_ps(a, b); }
+inline vfloat v_sub(vfloat a, vfloat b)      { return _mm_sub_ps(a, b); }
+inline vfloat v_mul(vfloat a, vfloat b)      { return _mm_mul_ps(a, b); }
+inline vfloat v_div(vfloat a, vfloat b)      { return _mm_div_ps(a, b); }
+inline vfloat v_sqrt(vfloat a)               { return _mm_sqrt_ps(a); }
+inline vfloat v_min(vfloat a, vfloat b)      { return _mm_min_ps(a, b); }
+inline vfloat v_max(vfloat a, vfloat b)      { return _mm_max_ps(a, b); }
+inline vfloat v_neg(vfloat a)                { return _mm_xor_ps(a, _mm_set1_ps(-0.0f)); }
+inline vfloat v_abs(vfloat a)                { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a); }
+inline vint   v_to_int(vfloat a)             { return _mm_cvtps_epi32(a); }
+inline vfloat v_to_float(vint a)             { return _mm_cvtepi32_ps(a); }
+inline vint   v_int_add(vint a, int b)       { return _mm_add_epi32(a, _mm_set1_epi32(b)); }
+inline vmask  v_bit_set(vint a, int bit)
+{
+    vint b = _mm_set1_epi32(bit);
+    return _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(a, b), b));
+}
+inline vfloat v_select(vmask m, vfloat a, vfloat b)
+{
+    return _mm_or_ps(_mm_and_ps(m, a), _mm_andnot_ps(m, b));
+}
+inline vmask  v_le(vfloat a, vfloat b)       { return _mm_cmple_ps(a, b); }
+inline vmask  v_gt(vfloat a, vfloat b)       { return _mm_cmpgt_ps(a, b); }
+inline vfloat v_gather(const float* p, const int32_t* i)
+{
+    return _mm_set_ps(p[i[3]], p[i[2]], p[i[1]], p[i[0]]);
+}
+
+#include "physics/kernels_simd.inl"
+
+}; // namespace simd_sse2
+
+CRADLE_TARGET_BEGIN(CRADLE_PRAGMA_AVX2)
+
+/* AVX2, 8 lanes */
+namespace simd_avx2
+{
+
+typedef __m256  vfloat;
+typedef __m256i vint;
+typedef __m256  vmask;
+
+static const size_t c_lanes = 8;
+
+inline vfloat v_load(const float* p)         { return _mm256_loadu_ps(p); }
+inline void   v_store(float* p, vfloat v)    { _mm256_storeu_ps(p, v); }
+inline vfloat v_set1(float f)                { return _mm256_set1_ps(f); }
+inline vfloat v_add(vfloat a, vfloat b)      { return _mm256_add_ps(a, b); }
+inline vfloat v_sub(vfloat a, vfloat b)      { return _mm256_sub_ps(a, b); }
+inline vfloat v_mul(vfloat a, vfloat b)      { return _mm256_mul_ps(a, b); }
+inline vfloat v_div(vfloat a, vfloat b)      { return _mm256_div_ps(a, b); }
+inline vfloat v_sqrt(vfloat a)               { return _mm256_sqrt_ps(a); }
+inline vfloat v_min(vfloat a, vfloat b)      { return _mm256_min_ps(a, b); }
+inline vfloat v_max(vfloat a, vfloat b)      { return _mm256_max_ps(a, b); }
+inline vfloat v_neg(vfloat a)                { return _mm256_xor_ps(a, _mm256_set1_ps(-0.0f)); }
+inline vfloat v_abs(vfloat a)                { return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a); }
+inline vint   v_to_int(vfloat a)             { return _mm256_cvtps_epi32(a); }
+inline vfloat v_to_float(vint a)             { return _mm256_cvtepi32_ps(a); }
+inline vint   v_int_add(vint a, int b)       { return _mm256_add_epi32(a, _mm256_set1_epi32(b)); }
+inline vmask  v_bit_set(vint a, int bit)
+{
+    vint b = _mm256_set1_epi32(bit);
+    return _mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_and_si256(a, b), b));
+}
+inline vfloat v_select(vmask m, vfloat a, vfloat b)
+{
+    return _mm256_blendv_ps(b, a, m);
+}
+inline vmask  v_le(vfloat a, vfloat b)       { return _mm256_cmp_ps(a, b, _CMP_LE_OQ); }
+inline vmask  v_gt(vfloat a, vfloat b)       { return _mm256_cmp_ps(a, b, _CMP_GT_OQ); }
+inline vfloat v_gather(const float* p, const int32_t* i)
+{
+    return _mm256_i32gather_ps(p, _mm256_loadu_si256((const __m256i*)i), 4);
+}
+
+#include "physics/kernels_simd.inl"
+
+}; // namespace simd_avx2
+
+CRADLE_TARGET_END
+
+CRADLE_TARGET_BEGIN(CRADLE_PRAGMA_AVX512)
+
+/* AVX-512F, 16 lanes */
+namespace simd_avx512
+{
+
+typedef __m512    vfloat;
+typedef __m512i   vint;
+typedef __mmask16 vmask;
+
+static const size_t c_lanes = 16;
+
+inline vfloat v_load(const float* p)         { return _mm512_loadu_ps(p); }
+inline void   v_store(float* p, vfloat v)    { _mm512_storeu_ps(p, v); }
+inline vfloat v_set1(float f)                { return _mm512_set1_ps(f); }
+inline vfloat v_add(vfloat a, vfloat b)      { return _mm512_add_ps(a, b); }
+inline vfloat v_sub(vfloat a, vfloat b)      { return _mm512_sub_ps(a, b); }
+inline vfloat v_mul(vfloat a, vfloat b)      { return _mm512_mul_ps(a, b); }
+inline vfloat v_div(vfloat a, vfloat b)      { return _mm512_div_ps(a, b); }
+inline vfloat v_sqrt(vfloat a)               { return _mm512_sqrt_ps(a); }
+inline vfloat v_min(vfloat a, vfloat b)      { return _mm512_min_ps(a, b); }
+inline vfloat v_max(vfloat a, vfloat b)      { return _mm512_max_ps(a, b); }
+inline vfloat v_neg(vfloat a)                { return _mm512_castsi512_ps(_mm512_xor_si512(_mm512_castps_si512(a), _mm512_set1_epi32(int(0x80000000)))); }
+inline vfloat v_abs(vfloat a)                { return _mm512_castsi512_ps(_mm512_and_si512(_mm512_castps_si512(a), _mm512_set1_epi32(0x7fffffff))); }
+inline vint   v_to_int(vfloat a)             { return _mm512_cvtps_epi32(a); }
+inline vfloat v_to_float(vint a)             { return _mm512_cvtepi32_ps(a); }
+inline vint   v_int_add(vint a, int b)       { return _mm512_add_epi32(a, _mm512_set1_epi32(b)); }
+inline vmask  v_bit_set(vint a, int bit)     { return _mm512_test_epi32_mask(a, _mm512_set1_epi32(bit)); }
+inline vfloat v_select(vmask m, vfloat a, vfloat b)
+{
+    return _mm512_mask_blend_ps(m, b, a);
+}
+inline vmask  v_le(vfloat a, vfloat b)       { return _mm512_cmp_ps_mask(a, b, _CMP_LE_OQ); }
+inline vmask  v_gt(vfloat a, vfloat b)       { return _mm512_cmp_ps_mask(a, b, _CMP_GT_OQ); }
+inline vfloat v_gather(const float* p, const int32_t* i)
+{
+    return _mm512_i32gather_ps(_mm512_loadu_si512(i), p, 4);
+}
+
+#include "physics/kernels_simd.inl"
+
+}; // namespace simd_avx512
+
+CRADLE_TARGET_END
+
+#endif // CRADLE_SIMD_X86
+
+namespace
+{
+
+const Kernels s_kernels[KernelSet::Count] =
+{
+    { KernelSet::Scalar, "scalar", 1,  body_store::update,  body_store::swing,  body_store::solve_constraint,  body_store::narrowphase,  body_store::transforms  },
+#if CRADLE_SIMD_X86
+    { KernelSet::SSE2,   "sse2",   4,  simd_sse2::update,   simd_sse2::swing,   simd_sse2::solve_constraint,   simd_sse2::narrowphase,   simd_sse2::transforms   },
+    { KernelSet::AVX2,   "avx2",   8,  simd_avx2::update,   simd_avx2::swing,   simd_avx2::solve_constraint,   simd_avx2::narrowphase,   simd_avx2::transforms   },
+    { KernelSet::AVX512, "avx512", 16, simd_avx512::update, simd_avx512::swing, simd_avx512::solve_constraint, simd_avx512::narrowphase, simd_avx512::transforms },
+#else
+    { KernelSet::SSE2,   "sse2",   4,  body_store::update,  body_store::swing,  body_store::solve_constraint,  body_store::narrowphase,  body_store::transforms  },
+    { KernelSet::AVX2,   "avx2",   8,  body_store::update,  body_store::swing,  body_store::solve_constraint,  body_store::narrowphase,  body_store::transforms  },
+    { KernelSet::AVX512, "avx512", 16, body_store::update,  body_store::swing,  body_store::solve_constraint,  body_store::narrowphase,  body_store::transforms  },
+#endif
+};
+
+const Kernels * s_active = NULL;
+
+#if CRADLE_SIMD_X86 && defined(_MSC_VER)
+bool cpu_supports(KernelSet::Enum set)
+{
+    int info[4];
+    __cpuid(info, 0);
+    int max_leaf = info[0];
+
+    __cpuid(info, 1);
+    bool sse2    = 0 != (info[3] & (1 << 26));
+    bool osxsave = 0 != (info[2] & (1 << 27));
+    bool avx     = 0 != (info[2] & (1 << 28));
+
+    if ( KernelSet::SSE2 == set ) return sse2;
+    if ( !osxsave || !avx || max_leaf < 7 ) return false;
+
+    unsigned long long xcr0 = _xgetbv(0);
+    __cpuidex(info, 7, 0);
+
+    if ( KernelSet::AVX2 == set )
+    {
+        return (xcr0 & 0x6) == 0x6 && 0 != (info[1] & (1 << 5));
+    }
+    return (xcr0 & 0xe6) == 0xe6 && 0 != (info[1] & (1 << 16));
+}
+#elif CRADLE_SIMD_X86
+bool cpu_supports(KernelSet::Enum set)
+{
+    __builtin_cpu_init();
+
+    switch ( set )
+    {
+        case KernelSet::SSE2:   return 0 != __builtin_cpu_supports("sse2");
+        case KernelSet::AVX2:   return 0 != __builtin_cpu_supports("avx2");
+        case KernelSet::AVX512: return 0 != __builtin_cpu_supports("avx512f");
+        default:                return false;
+    }
+}
+#else
+bool cpu_supports(KernelSet::Enum /* set */)
+{
+    return false;
+}
+#endif
+
+} // namespace
+
+namespace kernels
+{
+
+bool supported(KernelSet::Enum set)
+{
+    if ( KernelSet::Scalar == set ) return true;
+    if ( set >= KernelSet::Count ) return false;
+
+    return cpu_supports(set);
+}
+
+KernelSet::Enum best()
+{
+    for ( int set = KernelSet::Count - 1; set > KernelSet::Scalar; set-- )
+    {
+        if ( supported(KernelSet::Enum(set)) )
+        {
+            return KernelSet::Enum(set);
+        }
+    }
+
+    return KernelSet::Scalar;
+}
+
+const Kernels& get(KernelSet::Enum set)
+{
+    return s_kernels[set];
+}
+
+const Kernels& active()
+{
+    if ( NULL == s_active )
+    {
+        s_active = &s_kernels[best()];
+    }
+
+    return *s_active;
+}
+
+bool select(KernelSet::Enum set)
+{
+    if ( !supported(set) ) return false;
+
+    s_active = &s_kernels[set];
+    return true;
+}
+
+KernelSet::Enum from_name(const char* name)
+{
+    for ( int set = 0; set < KernelSet::Count; set++ )
+    {
+        if ( 0 == strcmp(name, s_kernels[set].name) )
+        {
+            return KernelSet::Enum(set);
+        }
+    }
+
+    return KernelSet::Count;
+}
+
+}; // namespace kernels
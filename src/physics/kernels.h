@@ -0,0 +1,80 @@
+/*
+ * Copyright (c) 2015 Jonathan Howard
+ * License: https://github.com/v3n/altertum/blob/master/LICENSE
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "physics/body_store.h"
+#include "physics/resolver.h"
+
+/**
+ * @file kernels.h
+ * Vectorized batch kernels for the integrators, string constraint,
+ * sphere narrowphase and render transforms
+ * The widest instruction set supported by the CPU is picked at runtime;
+ * the scalar set is the body_store:: reference path.
+ */
+
+struct KernelSet
+{
+    enum Enum
+    {
+        Scalar,
+        SSE2,
+        AVX2,
+        AVX512,
+
+        Count
+    };
+};
+
+typedef void (*UpdateKernel)(BodyStore& bodies, size_t begin, size_t end, float deltaTime, float correction);
+typedef void (*SwingKernel)(BodyStore& bodies, size_t begin, size_t end, float deltaTime, float correction, SwingIntegrator::Enum integrator);
+typedef void (*ConstraintKernel)(BodyStore& bodies, size_t begin, size_t end);
+typedef void (*NarrowphaseKernel)(const BodyStore& bodies, CollisionPair* pairs, size_t begin, size_t end, uint8_t* hit);
+typedef void (*TransformKernel)(const BodyPose& pose, size_t begin, size_t end, float alpha, const Vector3& offset, Matrix4* out);
+
+struct Kernels
+{
+    KernelSet::Enum   set;
+    const char *      name;
+    size_t            lanes;
+
+    /** body_store::update, bit-for-bit */
+    UpdateKernel      update;
+    /** body_store::swing, within float sin/cos accuracy */
+    SwingKernel       swing;
+    /** body_store::solve_constraint, within float sin/cos accuracy */
+    ConstraintKernel  solve_constraint;
+    /** body_store::narrowphase, bit-for-bit */
+    NarrowphaseKernel narrowphase;
+    /** body_store::transforms, within float sin/cos accuracy */
+    TransformKernel   transforms;
+};
+
+namespace kernels
+{
+
+/** Returns true if the CPU and OS can run kernel set @a set. */
+bool supported(KernelSet::Enum set);
+
+/** Widest supported kernel set. */
+KernelSet::Enum best();
+
+/** Kernel table for @a set, which must be supported. */
+const Kernels& get(KernelSet::Enum set);
+
+/** Kernels used by the simulation step, best() unless overridden. */
+const Kernels& active();
+
+/** Override the kernels used by the simulation step, returns false if unsupported. */
+bool select(KernelSet::Enum set);
+
+/** Parse a kernel set name as printed by Kernels::name, returns Count if unknown. */
+KernelSet::Enum from_name(const char* name);
+
+}; // namespace kernels
@@ -0,0 +1,325 @@
+/*
+ * Copyright (c) 2015 Jonathan Howard
+ * License: https://github.com/v3n/altertum/blob/master/LICENSE
+ */
+
+/**
+ * @file kernels_simd.inl
+ * Width-independent kernel bodies, included once per instruction set by
+ * kernels.cpp. The including namespace provides vfloat, vint, vmask,
+ * c_lanes and the v_* primitives.
+ */
+
+/** Cephes-style sin and cos for |x| up to a few thousand radians. */
+inline void v_sincos(vfloat x, vfloat& s, vfloat& c)
+{
+    const vfloat two_over_pi = v_set1(0.636619772367581343f);
+    const vfloat pio2_hi     = v_set1(1.5703125f);
+    const vfloat pio2_mid    = v_set1(4.837512969970703125e-4f);
+    const vfloat pio2_lo     = v_set1(7.54978995489188216e-8f);
+
+    /* reduce to [-pi/4, pi/4] and remember the quadrant */
+    vint    q = v_to_int(v_mul(x, two_over_pi));
+    vfloat qf = v_to_float(q);
+
+    vfloat r = v_sub(x, v_mul(qf, pio2_hi));
+    r = v_sub(r, v_mul(qf, pio2_mid));
+    r = v_sub(r, v_mul(qf, pio2_lo));
+
+    vfloat z = v_mul(r, r);
+
+    vfloat ps = v_set1(-1.9515295891e-4f);
+    ps = v_add(v_mul(ps, z), v_set1( 8.3321608736e-3f));
+    ps = v_add(v_mul(ps, z), v_set1(-1.6666654611e-1f));
+    ps = v_add(v_mul(v_mul(ps, z), r), r);
+
+    vfloat pc = v_set1(2.443315711809948e-5f);
+    pc = v_add(v_mul(pc, z), v_set1(-1.388731625493765e-3f));
+    pc = v_add(v_mul(pc, z), v_set1( 4.166664568298827e-2f));
+    pc = v_add(v_mul(v_mul(pc, z), z), v_sub(v_set1(1.0f), v_mul(z, v_set1(0.5f))));
+
+    /* quadrant 0: (s, c), 1: (c, -s), 2: (-s, -c), 3: (-c, s) */
+    vmask odd = v_bit_set(q, 1);
+    s = v_select(odd, pc, ps);
+    c = v_select(odd, ps, pc);
+
+    s = v_select(v_bit_set(q, 2), v_neg(s), s);
+    c = v_select(v_bit_set(v_int_add(q, 1), 2), v_neg(c), c);
+}
+
+/**
+ * The @a n lanes at @a p, @a n up to c_lanes; short loads repeat the last
+ * value, so no lane divides by 0.
+ */
+inline vfloat v_load_n(const float* p, size_t n)
+{
+    if ( n == c_lanes ) return v_load(p);
+
+    alignas(64) float lanes[c_lanes];
+    for ( size_t l = 0; l < c_lanes; l++ )
+    {
+        lanes[l] = p[l < n ? l : n - 1];
+    }
+    return v_load(lanes);
+}
+
+/** Store the first @a n lanes of @a v at @a p. */
+inline void v_store_n(float* p, vfloat v, size_t n)
+{
+    if ( n == c_lanes )
+    {
+        v_store(p, v);
+        return;
+    }
+
+    alignas(64) float lanes[c_lanes];
+    v_store(lanes, v);
+    for ( size_t l = 0; l < n; l++ )
+    {
+        p[l] = lanes[l];
+    }
+}
+
+inline void update(BodyStore& bodies, size_t begin, size_t end, float deltaTime, float correction)
+{
+    const vfloat deltaTimeSq = v_set1(deltaTime * deltaTime);
+    const vfloat frictionAir = v_set1(1 - BodyStore::frictionAir);
+    const vfloat corr        = v_set1(correction);
+    const vfloat inertia     = v_set1(BodyStore::inertia);
+
+    size_t i = begin;
+    for ( ; i + c_lanes <= end; i += c_lanes )
+    {
+        vfloat mass = v_load(bodies.mass + i);
+
+        vfloat px = v_load(bodies.position.x + i);
+        vfloat py = v_load(bodies.position.y + i);
+        vfloat pz = v_load(bodies.position.z + i);
+
+        /* Verlet integration for velocity */
+        vfloat vx = v_add(v_mul(v_mul(v_sub(px, v_load(bodies.lastPosition.x + i)), frictionAir), corr),
+                          v_mul(v_div(v_load(bodies.force.x + i), mass), deltaTimeSq));
+        vfloat vy = v_add(v_mul(v_mul(v_sub(py, v_load(bodies.lastPosition.y + i)), frictionAir), corr),
+                          v_mul(v_div(v_load(bodies.force.y + i), mass), deltaTimeSq));
+        vfloat vz = v_add(v_mul(v_mul(v_sub(pz, v_load(bodies.lastPosition.z + i)), frictionAir), corr),
+                          v_mul(v_div(v_load(bodies.force.z + i), mass), deltaTimeSq));
+
+        v_store(bodies.velocity.x + i, vx);
+        v_store(bodies.velocity.y + i, vy);
+        v_store(bodies.velocity.z + i, vz);
+
+        v_store(bodies.lastPosition.x + i, px);
+        v_store(bodies.lastPosition.y + i, py);
+        v_store(bodies.lastPosition.z + i, pz);
+
+        v_store(bodies.position.x + i, v_add(px, vx));
+        v_store(bodies.position.y + i, v_add(py, vy));
+        v_store(bodies.position.z + i, v_add(pz, vz));
+
+        /* Verlet integration for angular velocity */
+        vfloat angle = v_load(bodies.angle + i);
+        vfloat angularVelocity = v_add(v_mul(v_mul(v_sub(angle, v_load(bodies.lastAngle + i)), frictionAir), corr),
+                                       v_mul(v_div(v_load(bodies.torque + i), inertia), deltaTimeSq));
+
+        v_store(bodies.angularVelocity + i, angularVelocity);
+        v_store(bodies.lastAngle + i, angle);
+        v_store(bodies.angle + i, v_add(angle, angularVelocity));
+
+        /* track speed and acceleration */
+        v_store(bodies.speed + i, v_sqrt(v_add(v_add(v_mul(vx, vx), v_mul(vy, vy)), v_mul(vz, vz))));
+        v_store(bodies.angularSpeed + i, v_abs(angularVelocity));
+    }
+
+    body_store::update(bodies, i, end, deltaTime, correction);
+}
+
+inline void swing(BodyStore& bodies, size_t begin, size_t end, float deltaTime, float correction, SwingIntegrator::Enum integrator)
+{
+    /* the closed-form swing has no vector path */
+    if ( SwingIntegrator::Exact == integrator )
+    {
+        body_store::swing(bodies, begin, end, deltaTime, correction, integrator);
+        return;
+    }
+
+    const vfloat to_radians = v_set1(float(M_PI / 180));
+    const vfloat damping    = v_set1(powf(1 - BodyStore::frictionAir, deltaTime / g_fixedDeltaTime) * correction);
+    const vfloat gravity    = v_set1(BodyStore::gravity);
+    const vfloat dt         = v_set1(deltaTime);
+    const vfloat half       = v_set1(0.5f);
+
+    /* the tail goes through the same math, so no body steps by its lane */
+    for ( size_t i = begin; i < end; i += c_lanes )
+    {
+        size_t n = end - i < c_lanes ? end - i : c_lanes;
+
+        vfloat degrees = v_load_n(bodies.angle + i, n);
+        vfloat angle = v_mul(degrees, to_radians);
+        vfloat rate = v_mul(v_mul(v_sub(degrees, v_load_n(bodies.lastAngle + i, n)), damping), to_radians);
+        vfloat k = v_mul(v_mul(v_div(gravity, v_load_n(bodies.constraintLen + i, n)), dt), dt);
+
+        vfloat sin_a, cos_a;
+        if ( SwingIntegrator::Leapfrog == integrator )
+        {
+            v_sincos(angle, sin_a, cos_a);
+            rate  = v_sub(rate, v_mul(v_mul(half, k), sin_a));
+            angle = v_add(angle, rate);
+            v_sincos(angle, sin_a, cos_a);
+            rate  = v_sub(rate, v_mul(v_mul(half, k), sin_a));
+        }
+        else
+        {
+            for ( size_t stage = 0; stage < 3; stage++ )
+            {
+                angle = v_add(angle, v_mul(v_set1(g_yoshidaDrift[stage]), rate));
+                v_sincos(angle, sin_a, cos_a);
+                rate  = v_sub(rate, v_mul(v_mul(v_set1(g_yoshidaKick[stage]), k), sin_a));
+            }
+            angle = v_add(angle, v_mul(v_set1(g_yoshidaDrift[3]), rate));
+        }
+
+        v_store_n(bodies.lastPosition.x + i, v_load_n(bodies.position.x + i, n), n);
+        v_store_n(bodies.lastPosition.y + i, v_load_n(bodies.position.y + i, n), n);
+        v_store_n(bodies.lastPosition.z + i, v_load_n(bodies.position.z + i, n), n);
+
+        degrees = v_div(angle, to_radians);
+        vfloat angularVelocity = v_div(rate, to_radians);
+
+        v_store_n(bodies.angle + i, degrees, n);
+        v_store_n(bodies.angularVelocity + i, angularVelocity, n);
+        v_store_n(bodies.lastAngle + i, v_sub(degrees, angularVelocity), n);
+        v_store_n(bodies.angularSpeed + i, v_abs(angularVelocity), n);
+    }
+}
+
+inline void solve_constraint(BodyStore& bodies, size_t begin, size_t end)
+{
+    const vfloat to_radians = v_set1(float(M_PI / 180));
+
+    /* the tail goes through the same math, so no body steps by its lane */
+    for ( size_t i = begin; i < end; i += c_lanes )
+    {
+        size_t n = end - i < c_lanes ? end - i : c_lanes;
+
+        vfloat sin_a, cos_a;
+        v_sincos(v_mul(v_load_n(bodies.angle + i, n), to_radians), sin_a, cos_a);
+
+        vfloat length = v_load_n(bodies.constraintLen + i, n);
+        vfloat px = v_sub(v_load_n(bodies.constraintLoc.x + i, n), v_mul(length, sin_a));
+        vfloat py = v_sub(v_load_n(bodies.constraintLoc.y + i, n), v_mul(length, cos_a));
+        vfloat pz = v_load_n(bodies.constraintLoc.z + i, n);
+
+        vfloat vx = v_sub(px, v_load_n(bodies.lastPosition.x + i, n));
+        vfloat vy = v_sub(py, v_load_n(bodies.lastPosition.y + i, n));
+        vfloat vz = v_sub(pz, v_load_n(bodies.lastPosition.z + i, n));
+
+        v_store_n(bodies.velocity.x + i, vx, n);
+        v_store_n(bodies.velocity.y + i, vy, n);
+        v_store_n(bodies.velocity.z + i, vz, n);
+        v_store_n(bodies.speed + i, v_sqrt(v_add(v_add(v_mul(vx, vx), v_mul(vy, vy)), v_mul(vz, vz))), n);
+
+        v_store_n(bodies.position.x + i, px, n);
+        v_store_n(bodies.position.y + i, py, n);
+        v_store_n(bodies.position.z + i, pz, n);
+
+        v_store_n(bodies.origin.x + i, px, n);
+        v_store_n(bodies.origin.y + i, py, n);
+        v_store_n(bodies.origin.z + i, pz, n);
+    }
+}
+
+inline void transforms(const BodyPose& pose, size_t begin, size_t end, float alpha, const Vector3& offset, Matrix4* out)
+{
+    const vfloat to_radians = v_set1(float(M_PI / 180));
+    const vfloat t  = v_set1(alpha);
+    const vfloat ox = v_set1(offset.x);
+    const vfloat oy = v_set1(offset.y);
+    const vfloat oz = v_set1(offset.z);
+
+    /* lanes go out one matrix at a time, rows are interleaved per body */
+    alignas(64) float sin_l[c_lanes], cos_l[c_lanes], x_l[c_lanes], y_l[c_lanes], z_l[c_lanes];
+
+    /* the tail goes through the same math, so no body turns by its lane */
+    for ( size_t i = begin; i < end; i += c_lanes )
+    {
+        size_t n = end - i < c_lanes ? end - i : c_lanes;
+
+        vfloat last = v_load_n(pose.lastAngle + i, n);
+        vfloat angle = v_add(last, v_mul(v_sub(v_load_n(pose.angle + i, n), last), t));
+
+        vfloat sin_a, cos_a;
+        v_sincos(v_mul(angle, to_radians), sin_a, cos_a);
+
+        v_store(sin_l, sin_a);
+        v_store(cos_l, cos_a);
+        v_store(x_l, v_add(v_load_n(pose.pivotX + i, n), ox));
+        v_store(y_l, v_add(v_load_n(pose.pivotY + i, n), oy));
+        v_store(z_l, v_add(v_load_n(pose.pivotZ + i, n), oz));
+
+        for ( size_t l = 0; l < n; l++ )
+        {
+            body_store::write_transform(out[i + l], sin_l[l], cos_l[l], x_l[l], y_l[l], z_l[l]);
+        }
+    }
+}
+
+inline void narrowphase(const BodyStore& bodies, CollisionPair* pairs, size_t begin, size_t end, uint8_t* hit)
+{
+    const vfloat zero    = v_set1(0.0f);
+    const vfloat one     = v_set1(1.0f);
+    const vfloat epsilon = v_set1(g_contactEpsilon);
+
+    int32_t a[c_lanes];
+    int32_t b[c_lanes];
+
+    /* normal xyz, tangent xy, penetration, touching */
+    float out[7][c_lanes];
+
+    size_t i = begin;
+    for ( ; i + c_lanes <= end; i += c_lanes )
+    {
+        for ( size_t l = 0; l < c_lanes; l++ )
+        {
+            a[l] = (int32_t)pairs[i + l].bodyA;
+            b[l] = (int32_t)pairs[i + l].bodyB;
+        }
+
+        vfloat dx = v_sub(v_gather(bodies.origin.x, b), v_gather(bodies.origin.x, a));
+        vfloat dy = v_sub(v_gather(bodies.origin.y, b), v_gather(bodies.origin.y, a));
+        vfloat dz = v_sub(v_gather(bodies.origin.z, b), v_gather(bodies.origin.z, a));
+        vfloat radius = v_add(v_gather(bodies.radius, a), v_gather(bodies.radius, b));
+
+        vfloat distance_sq = v_add(v_add(v_mul(dx, dx), v_mul(dy, dy)), v_mul(dz, dz));
+        vfloat distance = v_sqrt(distance_sq);
+
+        /* coincident centers push apart along the cradle */
+        vmask apart = v_gt(distance, epsilon);
+        vfloat nx = v_select(apart, v_div(dx, distance), one);
+        vfloat ny = v_select(apart, v_div(dy, distance), zero);
+        vfloat nz = v_select(apart, v_div(dz, distance), zero);
+
+        vfloat planar = v_sqrt(v_add(v_mul(nx, nx), v_mul(ny, ny)));
+        vmask tilted = v_gt(planar, epsilon);
+        vfloat tx = v_select(tilted, v_div(v_neg(ny), planar), zero);
+        vfloat ty = v_select(tilted, v_div(nx, planar), one);
+
+        v_store(out[0], nx);
+        v_store(out[1], ny);
+        v_store(out[2], nz);
+        v_store(out[3], tx);
+        v_store(out[4], ty);
+        v_store(out[5], v_sub(radius, distance));
+        v_store(out[6], v_select(v_le(distance_sq, v_mul(radius, radius)), one, zero));
+
+        for ( size_t l = 0; l < c_lanes; l++ )
+        {
+            Collision& c = pairs[i + l].collision;
+            c.normal      = vector3::vector3(out[0][l], out[1][l], out[2][l]);
+            c.tangent     = vector3::vector3(out[3][l], out[4][l], 0.0f);
+            c.penetration = out[5][l];
+            hit[i + l]    = out[6][l] > 0.0f ? 1 : 0;
+        }
+    }
+
+    body_store::narrowphase(bodies, pairs, i, end, hit);
+}
@@ -0,0 +1,181 @@
+/*
+ * Copyright (c) 2015 Jonathan Howard
+ * License: https://github.com/v3n/altertum/blob/master/LICENSE
+ */
+
+#pragma once
+
+#include <cmath>
+
+/**
+ * @file pendulum.h
+ * Exact motion of a frictionless pendulum
+ * A swing below the pivot follows sin(angle / 2) = k sn(u | k^2), with the
+ * phase u advancing at w = sqrt(gravity / length), so a later state costs
+ * one Jacobi elliptic evaluation however far ahead it is. Angles are in
+ * radians, time in simulation units, and everything is in double.
+ */
+
+/** largest k^2 a swing may have, swings over the top are not modelled */
+static const double g_maxSwingModulus = 1.0 - 1e-12;
+
+namespace pendulum
+{
+
+/** Carlson's symmetric elliptic integral R_F(x, y, z), at most one argument zero. */
+inline double carlson_rf(double x, double y, double z)
+{
+    for ( ;; )
+    {
+        double mean = (x + y + z) / 3;
+        double dx = 1 - x / mean;
+        double dy = 1 - y / mean;
+        double dz = 1 - z / mean;
+
+        /* the series below is accurate to the sixth power of the spread */
+        if ( fmax(fabs(dx), fmax(fabs(dy), fabs(dz))) < 1e-3 )
+        {
+            double e2 = dx * dy - dz * dz;
+            double e3 = dx * dy * dz;
+            return (1 - e2 / 10 + e3 / 14 + e2 * e2 / 24 - 3 * e2 * e3 / 44) / sqrt(mean);
+        }
+
+        double lambda = sqrt(x * y) + sqrt(y * z) + sqrt(z * x);
+        x = (x + lambda) / 4;
+        y = (y + lambda) / 4;
+        z = (z + lambda) / 4;
+    }
+}
+
+/** Complete elliptic integral of the first kind K(m), by the arithmetic-geometric mean. */
+inline double complete_k(double m)
+{
+    double a = 1.0;
+    double b = sqrt(1 - m);
+
+    while ( fabs(a - b) > 1e-15 * a )
+    {
+        double next = (a + b) / 2;
+        b = sqrt(a * b);
+        a = next;
+    }
+
+    return M_PI / (2 * a);
+}
+
+/** Incomplete elliptic integral of the first kind F(phi | m), for |phi| <= pi / 2. */
+inline double incomplete_f(double phi, double m)
+{
+    double s = sin(phi);
+    double c = cos(phi);
+    return s * carlson_rf(c * c, 1 - m * s * s, 1.0);
+}
+
+/** Jacobi sn(u | m) and cn(u | m), by descending Landen transformation. */
+inline void jacobi_sncn(double u, double m, double& sn, double& cn)
+{
+    const int c_maxSteps = 16;
+
+    double a[c_maxSteps + 1];
+    double c[c_maxSteps + 1];
+
+    a[0] = 1.0;
+    c[0] = sqrt(m);
+    double b = sqrt(1 - m);
+
+    int n = 0;
+    while ( fabs(c[n]) > 1e-15 && n < c_maxSteps )
+    {
+        a[n + 1] = (a[n] + b) / 2;
+        c[n + 1] = (a[n] - b) / 2;
+        b = sqrt(a[n] * b);
+        n++;
+    }
+
+    double phi = ldexp(a[n] * u, n);
+    for ( ; n > 0; n-- )
+    {
+        phi = (phi + asin(c[n] / a[n] * sin(phi))) / 2;
+    }
+
+    sn = sin(phi);
+    cn = cos(phi);
+}
+
+}; // namespace pendulum
+
+/** One pendulum's swing, fixed by its state at a reference time */
+struct Swing
+{
+    /** sine of half the amplitude */
+    double k;
+    /** quarter period in phase, K(k^2) */
+    double quarter;
+    /** phase at t0, in [0, 4 quarter) */
+    double phase;
+    double t0;
+    /** phase rate, sqrt(gravity / length) */
+    double w;
+
+    /**
+     * Start the swing from @a angle and @a rate at time @a t
+     * @param _w sqrt(gravity / length) of the pendulum
+     */
+    inline void set(double angle, double rate, double _w, double t)
+    {
+        w  = _w;
+        t0 = t;
+
+        double s = sin(angle / 2);
+        double v = rate / (2 * w);
+        /* swings with the energy to go over the top are held just below it */
+        double m = fmin(s * s + v * v, g_maxSwingModulus);
+        k = sqrt(m);
+        quarter = pendulum::complete_k(m);
+
+        if ( 0.0 == k )
+        {
+            phase = 0.0;
+            return;
+        }
+
+        /* cn, and so the rate, is positive on (-K, K) */
+        double x = fmax(-1.0, fmin(1.0, s / k));
+        double u = pendulum::incomplete_f(asin(x), m);
+        if ( rate < 0 ) u = 2 * quarter - u;
+        if ( u < 0 ) u += 4 * quarter;
+
+        phase = u;
+    }
+
+    /** Angle and rate at time @a t. */
+    inline void at(double t, double& angle, double& rate) const
+    {
+        if ( 0.0 == k )
+        {
+            angle = 0.0;
+            rate  = 0.0;
+            return;
+        }
+
+        double u = fmod(phase + w * (t - t0), 4 * quarter);
+
+        double sn, cn;
+        pendulum::jacobi_sncn(u, k * k, sn, cn);
+
+        angle = 2 * asin(k * sn);
+        rate  = 2 * k * w * cn;
+    }
+
+    /** Fastest rate the swing reaches, at the bottom. */
+    inline double max_rate() const
+    {
+        return 2 * k * w;
+    }
+
+    /** Time of one full swing. */
+    inline double period() const
+    {
+        return 4 * quarter / w;
+    }
+};
@@ -0,0 +1,294 @@
+/*
+ * Copyright (c) 2015 Jonathan Howard
+ * License: https://github.com/v3n/altertum/blob/master/LICENSE
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+/** first bytes of a saved replay log, and its format version */
+static const uint32_t g_replayMagic   = 0x4c504352; // "RCPL"
+static const uint32_t g_replayVersion = 1;
+
+/**
+ * @file replay.h
+ * Compact log of everything a run was given, to re-simulate it headless
+ * A step only depends on the body state, the settings and its time step,
+ * so bodies, starting angles, pushes, settings and steps are all a run
+ * needs. Each record is a type byte and a fixed payload; runs of equal
+ * steps fold into one record, so a log grows with the inputs rather than
+ * with the run time. State hashes may be logged along the way and are
+ * checked on playback (see Simulation::play()). Logs are written in the
+ * byte order of the machine, which is little-endian everywhere we build.
+ */
+
+/** Kinds of replay record. */
+struct ReplayRecord
+{
+    enum Enum
+    {
+        /** ReplayConfig for the following records */
+        Config,
+        /** Simulation::create_bodies() */
+        CreateBodies,
+        /** Simulation::set_starting_angles() */
+        StartingAngles,
+        /** Simulation::push() */
+        Push,
+        /** count steps of the same time step */
+        Steps,
+        /** body_store::state_hash() at this point */
+        Hash,
+
+        Count
+    };
+};
+
+/** Simulation settings a step depends on, as logged */
+struct ReplayConfig
+{
+    enum Flags
+    {
+        WarmStarting        = 1 << 0,
+        AllowSleeping       = 1 << 1,
+        ContinuousCollision = 1 << 2,
+    };
+
+    uint8_t  engine;
+    uint8_t  integrator;
+    uint8_t  contactOrder;
+    uint8_t  broadphase;
+    uint8_t  kernels;
+    uint8_t  flags;
+    uint16_t padding;
+    uint32_t cradleSize;
+
+    inline bool operator==(const ReplayConfig& other) const
+    {
+        return 0 == memcmp(this, &other, sizeof(ReplayConfig));
+    }
+};
+
+/** One decoded record, only the fields of its type are set */
+struct ReplayEntry
+{
+    ReplayRecord::Enum type;
+    ReplayConfig config;
+
+    uint32_t count;
+    uint32_t index;
+    uint32_t left;
+    uint32_t right;
+
+    float mass;
+    float radius;
+    float length;
+    float degrees;
+    float deltaTime;
+    float correction;
+
+    uint64_t hash;
+};
+
+struct ReplayLog
+{
+    /** encoded records */
+    std::vector<uint8_t> data;
+
+    ReplayLog()
+        : last_steps(c_none)
+        , has_config(false)
+    {
+        memset(&config, 0, sizeof(config));
+    }
+
+    inline void clear()
+    {
+        data.clear();
+        last_steps = c_none;
+        has_config = false;
+    }
+
+    /** Log @a _config if it differs from the last one logged. */
+    inline void set_config(const ReplayConfig& _config)
+    {
+        if ( has_config && config == _config ) return;
+
+        config = _config;
+        has_config = true;
+
+        begin(ReplayRecord::Config);
+        write(config);
+    }
+
+    inline void create_bodies(uint32_t n_bodies, float mass, float radius, float length)
+    {
+        begin(ReplayRecord::CreateBodies);
+        write(n_bodies);
+        write(mass);
+        write(radius);
+        write(length);
+    }
+
+    inline void starting_angles(float degrees, uint32_t left, uint32_t right)
+    {
+        begin(ReplayRecord::StartingAngles);
+        write(degrees);
+        write(left);
+        write(right);
+    }
+
+    inline void push(uint32_t i, float degrees)
+    {
+        begin(ReplayRecord::Push);
+        write(i);
+        write(degrees);
+    }
+
+    /** Log a step, added to the last record if that was the same step. */
+    inline void step(float deltaTime, float correction)
+    {
+        if ( c_none != last_steps )
+        {
+            float last_dt, last_correction;
+            memcpy(&last_dt,         &data[last_steps + 4], sizeof(float));
+            memcpy(&last_correction, &data[last_steps + 8], sizeof(float));
+
+            uint32_t count;
+            memcpy(&count, &data[last_steps], sizeof(count));
+
+            if ( last_dt == deltaTime && last_correction == correction && count < 0xffffffff )
+            {
+                count++;
+                memcpy(&data[last_steps], &count, sizeof(count));
+                return;
+            }
+        }
+
+        begin(ReplayRecord::Steps);
+        last_steps = data.size();
+        write(uint32_t(1));
+        write(deltaTime);
+        write(correction);
+    }
+
+    inline void hash(uint64_t state_hash)
+    {
+        begin(ReplayRecord::Hash);
+        write(state_hash);
+    }
+
+    /**
+     * Decode the record at @a offset into @a entry and move past it
+     * Returns false at the end of the log or on a malformed record.
+     */
+    inline bool read(size_t& offset, ReplayEntry& entry) const
+    {
+        if ( offset >= data.size() || data[offset] >= ReplayRecord::Count ) return false;
+
+        entry.type = (ReplayRecord::Enum)data[offset];
+        size_t at = offset + 1;
+
+        bool ok = true;
+        switch ( entry.type )
+        {
+            case ReplayRecord::Config:
+                ok = read(at, entry.config);
+                break;
+            case ReplayRecord::CreateBodies:
+                ok = read(at, entry.count) && read(at, entry.mass) && read(at, entry.radius) && read(at, entry.length);
+                break;
+            case ReplayRecord::StartingAngles:
+                ok = read(at, entry.degrees) && read(at, entry.left) && read(at, entry.right);
+                break;
+            case ReplayRecord::Push:
+                ok = read(at, entry.index) && read(at, entry.degrees);
+                break;
+            case ReplayRecord::Steps:
+                ok = read(at, entry.count) && read(at, entry.deltaTime) && read(at, entry.correction);
+                break;
+            case ReplayRecord::Hash:
+                ok = read(at, entry.hash);
+                break;
+            default:
+                ok = false;
+                break;
+        }
+
+        if ( ok ) offset = at;
+        return ok;
+    }
+
+    /** Write the log to @a path, returns false if it could not be written. */
+    inline bool save(const char* path) const
+    {
+        FILE* file = fopen(path, "wb");
+        if ( NULL == file ) return false;
+
+        uint32_t header[3] = { g_replayMagic, g_replayVersion, (uint32_t)data.size() };
+        bool ok = 1 == fwrite(header, sizeof(header), 1, file)
+               && (data.empty() || 1 == fwrite(data.data(), data.size(), 1, file));
+
+        return 0 == fclose(file) && ok;
+    }
+
+    /** Read a log written by save(), returns false if it is missing or not a log of this version. */
+    inline bool load(const char* path)
+    {
+        clear();
+
+        FILE* file = fopen(path, "rb");
+        if ( NULL == file ) return false;
+
+        uint32_t header[3];
+        bool ok = 1 == fread(header, sizeof(header), 1, file)
+               && g_replayMagic == header[0]
+               && g_replayVersion == header[1];
+
+        if ( ok )
+        {
+            data.resize(header[2]);
+            ok = data.empty() || 1 == fread(data.data(), data.size(), 1, file);
+        }
+
+        fclose(file);
+
+        if ( !ok ) clear();
+        return ok;
+    }
+
+private:
+    static const size_t c_none = ~size_t(0);
+
+    inline void begin(ReplayRecord::Enum type)
+    {
+        data.push_back((uint8_t)type);
+        last_steps = c_none;
+    }
+
+    template <typename T>
+    inline void write(const T& value)
+    {
+        const uint8_t* bytes = (const uint8_t*)&value;
+        data.insert(data.end(), bytes, bytes + sizeof(T));
+    }
+
+    template <typename T>
+    inline bool read(size_t& at, T& value) const
+    {
+        if ( at + sizeof(T) > data.size() ) return false;
+
+        memcpy(&value, &data[at], sizeof(T));
+        at += sizeof(T);
+        return true;
+    }
+
+    /** offset of the payload of the last record if it is Steps */
+    size_t       last_steps;
+    ReplayConfig config;
+    bool         has_config;
+};
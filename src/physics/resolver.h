@@ -9,133 +9,312 @@
 
 #include "math/math_types.h"
 
+#include "physics/body_store.h"
+
 using namespace altertum;
 
-static const float g_restingThreshold = 4.0f; 
+/**
+ * @file resolver.h
+ * Sequential impulse contact solver
+ * Bodies are pendulums, so contacts push on swing angles: each contact
+ * normal is projected onto the path of both spheres, and impulses change
+ * angles and last angles. Impulses a contact accumulates stay on its pair
+ * and warm start the next step while the contact rests, so stacks of
+ * touching bodies settle in a few iterations.
+ * Every per-contact function touches only the pair and its two bodies.
+ */
+
+/** closing speeds under this many fixed steps of gravity are resting contacts */
+static const float g_restingThreshold = 1.0f;
 static const float g_positionWarming = 0.8f;
 static const float g_positionDampen = 0.9f;
-static const float g_frictionNormalMult = 5.0f;
 static const size_t g_positionIterations = 6;
 static const size_t g_velocityIterations = 4;
+/**
+ * bodies whose sphere moves more than this many radii in a step are swept
+ * for impacts, so no impact is solved deeper than this whatever the step
+ */
+static const float g_sweepMotion = 0.1f;
+/** bodies moving under this fraction of the resting speed are still */
+static const float g_sleepSpeed = 0.1f;
+/** time a body stays still before it sleeps, more than one swing */
+static const float g_sleepTime = 12.0f;
 
-struct Collision
-{
-    float penetration;
-    Vector3 normal;
-    Vector3 tangent;
-};
-
+/** Pair of bodies, by index into the BodyStore */
 struct CollisionPair
 {
-    PhysicsBody * bodyA;
-    PhysicsBody * bodyB;
+    uint32_t bodyA;
+    uint32_t bodyB;
     Collision collision;
     
     float seperation;
     Vector3 normal;
 
+    /** impulses accumulated by the solver, kept across steps to warm start it */
+    float normalImpulse;
+    float tangentImpulse;
+
+    /** contact normal and tangent per degree of swing of each body */
+    float normalA;
+    float normalB;
+    float tangentA;
+    float tangentB;
+    /** inverse swing inertia of each body */
+    float inverseA;
+    float inverseB;
+    /** inverse effective masses along the normal and tangent */
+    float normalMass;
+    float tangentMass;
+
     static constexpr float slop = 0.05f;
 };
 
-inline void presolve_positions(std::vector<CollisionPair>& pairs)
+namespace body_store
 {
-    for ( size_t i = 0; i < pairs.size(); i++ )
-    {
-        PhysicsBody * BodyA = pairs[i].bodyA;
-        PhysicsBody * BodyB = pairs[i].bodyB;
 
-        pairs[i].collision.normal = vector3::vector3(1.0f, 0.0f, 0.0f);
+/**
+ * Sphere-sphere narrowphase over pairs [begin, end)
+ * Fills each pair's collision and sets hit[i] to 1 if its bodies overlap.
+ * Reference path for the batched kernels.
+ */
+inline void narrowphase(const BodyStore& s, CollisionPair* pairs, size_t begin, size_t end, uint8_t* hit)
+{
+    for ( size_t i = begin; i < end; i++ )
+    {
+        BoundingSphere sphere_a = s.sphere(pairs[i].bodyA);
+        BoundingSphere sphere_b = s.sphere(pairs[i].bodyB);
 
-        BodyA->total_contacts++;
-        BodyB->total_contacts++;
+        hit[i] = sphere_a.collide(sphere_b, pairs[i].collision) ? 1 : 0;
     }
 }
 
-inline void solve_positions(std::vector<CollisionPair>& pairs)
+}; // namespace body_store
+
+/**
+ * Fraction of the last step at which the spheres of @a pair first touch
+ * Both spheres move in a straight line from lastPosition to position, so
+ * the contact is the first root of a quadratic in the fraction. Returns 1
+ * if they do not meet within the step or already overlapped as it began.
+ */
+inline float time_of_impact(const BodyStore& bodies, const CollisionPair& pair)
 {
-    Vector3 tempA, tempB, tempC, tempD;
+    uint32_t a = pair.bodyA;
+    uint32_t b = pair.bodyB;
 
-    for ( size_t i = 0; i < pairs.size(); i++ )
-    {
-        CollisionPair * pair = &(pairs[i]);
+    Vector3 start = bodies.lastPosition.get(b) - bodies.lastPosition.get(a);
+    Vector3 end   = bodies.position.get(b) - bodies.position.get(a);
+    Vector3 motion = end - start;
 
-        tempA = pair->bodyB->positionImpulse + pair->bodyB->position;
-        tempB = pair->bodyB->position - pair->collision.penetration;
-        tempC = pair->bodyA->positionImpulse + tempB;
-        tempD = tempA - tempC;
+    float r = bodies.radius[a] + bodies.radius[b];
+    float qa = vector3::dot(motion, motion);
+    float qb = 2 * vector3::dot(start, motion);
+    float qc = vector3::dot(start, start) - r * r;
 
-        pair->seperation = vector3::dot(pair->collision.normal, tempD);
-    }
+    if ( qc <= 0 || qb >= 0 || qa <= 0 ) return 1.0f;
 
-    for ( size_t i = 0; i < pairs.size(); i++ )
-    {
-        CollisionPair pair = pairs[i];
-        Collision collision = pair.collision;
-        PhysicsBody * BodyA = pair.bodyA;
-        PhysicsBody * BodyB = pair.bodyB;
-        Vector3 normal = collision.normal;
+    float discriminant = qb * qb - 4 * qa * qc;
+    if ( discriminant < 0 ) return 1.0f;
 
-        float positionImpulse = (pair.seperation - CollisionPair::slop);
+    float t = (-qb - sqrtf(discriminant)) / (2 * qa);
+    return t < 1 ? t : 1.0f;
+}
 
-        float cA = 0.04 / BodyA->total_contacts;
-        float cB = 0.04 / BodyB->total_contacts;
+/** Path of the sphere of body @a i per degree of swing. */
+inline Vector3 swing_axis(const BodyStore& bodies, uint32_t i)
+{
+    const float to_radians = float(M_PI / 180);
 
-        BodyA->positionImpulse += normal * BodyA->positionImpulse * cA;
-        BodyB->positionImpulse += normal * BodyB->positionImpulse * cB;
-    } 
+    float rad = bodies.angle[i] * to_radians;
+    float k = bodies.constraintLen[i] * to_radians;
+    return vector3::vector3(-k * cosf(rad), k * sinf(rad), 0.0f);
 }
 
-inline void postsolve_positions(std::vector<PhysicsBody>& bodies)
+/** Apply impulses along the normal and tangent of @a pair to its bodies' velocities. */
+inline void apply_impulse(BodyStore& bodies, const CollisionPair& pair, float normal, float tangent)
 {
-    for ( size_t i = 0; i < bodies.size(); i++ )
+    bodies.lastAngle[pair.bodyA] += (normal * pair.normalA + tangent * pair.tangentA) * pair.inverseA;
+    bodies.lastAngle[pair.bodyB] -= (normal * pair.normalB + tangent * pair.tangentB) * pair.inverseB;
+}
+
+/** Count the contact and cache its projections, once per step. */
+inline void presolve_position(BodyStore& bodies, CollisionPair& pair)
+{
+    uint32_t a = pair.bodyA;
+    uint32_t b = pair.bodyB;
+    const Collision& c = pair.collision;
+
+    bodies.total_contacts[a]++;
+    bodies.total_contacts[b]++;
+
+    Vector3 axis_a = swing_axis(bodies, a);
+    Vector3 axis_b = swing_axis(bodies, b);
+
+    pair.normalA  = vector3::dot(c.normal, axis_a);
+    pair.normalB  = vector3::dot(c.normal, axis_b);
+    pair.tangentA = vector3::dot(c.tangent, axis_a);
+    pair.tangentB = vector3::dot(c.tangent, axis_b);
+
+    pair.inverseA = 1 / (bodies.mass[a] * vector3::dot(axis_a, axis_a));
+    pair.inverseB = 1 / (bodies.mass[b] * vector3::dot(axis_b, axis_b));
+
+    float k_normal  = pair.normalA * pair.normalA * pair.inverseA + pair.normalB * pair.normalB * pair.inverseB;
+    float k_tangent = pair.tangentA * pair.tangentA * pair.inverseA + pair.tangentB * pair.tangentB * pair.inverseB;
+
+    pair.normalMass  = k_normal  > 0 ? 1 / k_normal  : 0.0f;
+    pair.tangentMass = k_tangent > 0 ? 1 / k_tangent : 0.0f;
+}
+
+/**
+ * Push the bodies of @a pair apart
+ * Corrections gather in each body's angle impulse and are applied by
+ * postsolve_positions, split between the contacts of a body.
+ */
+inline void solve_position(BodyStore& bodies, CollisionPair& pair)
+{
+    uint32_t a = pair.bodyA;
+    uint32_t b = pair.bodyB;
+
+    pair.seperation = pair.collision.penetration
+                    - (pair.normalB * bodies.angleImpulse[b] - pair.normalA * bodies.angleImpulse[a]);
+
+    if ( pair.seperation <= CollisionPair::slop ) return;
+
+    float impulse = (pair.seperation - CollisionPair::slop) * pair.normalMass * g_positionDampen;
+
+    bodies.angleImpulse[a] -= impulse * pair.normalA * pair.inverseA / bodies.total_contacts[a];
+    bodies.angleImpulse[b] += impulse * pair.normalB * pair.inverseB / bodies.total_contacts[b];
+}
+
+/**
+ * Move bodies [begin, end) by their angle impulses, without changing velocity
+ * What is left of an impulse warms the next step unless the body already
+ * moves the other way. Bodies out of contact are not moved; an impulse
+ * left from an earlier contact would lift them a little every step.
+ */
+inline void postsolve_positions(BodyStore& bodies, size_t begin, size_t end)
+{
+    for ( size_t i = begin; i < end; i++ )
     {
-        PhysicsBody & body = bodies[i];
-        
-        if ( vector3::distance(body.impulse) > 0 )
+        float impulse = bodies.angleImpulse[i];
+
+        if ( 0 == bodies.total_contacts[i] )
         {
-            body.lastPosition += body.positionImpulse;
-        
-            if ( vector3::dot(body.positionImpulse, body.velocity) < 0 )
-            {
-                body.positionImpulse.x = 0;
-                body.positionImpulse.y = 0;
-                body.positionImpulse.z = 0;
-            }
-            else
+            bodies.angleImpulse[i] = 0.0f;
+        }
+        else if ( impulse != 0.0f )
+        {
+            bodies.angle[i] += impulse;
+            bodies.lastAngle[i] += impulse;
+
+            impulse *= g_positionWarming;
+            if ( impulse * (bodies.angle[i] - bodies.lastAngle[i]) < 0 || fabsf(impulse) < g_contactEpsilon )
             {
-                body.positionImpulse *= g_positionWarming;
+                impulse = 0.0f;
             }
+            bodies.angleImpulse[i] = impulse;
         }
 
-        body.total_contacts = 0;
+        bodies.total_contacts[i] = 0;
     }
 }
 
-inline void presolve_velocities(std::vector<CollisionPair>& pairs)
+/** Speed at which the bodies of @a pair approach along its normal. */
+inline float closing_speed(const BodyStore& bodies, const CollisionPair& pair)
+{
+    float w_a = bodies.angle[pair.bodyA] - bodies.lastAngle[pair.bodyA];
+    float w_b = bodies.angle[pair.bodyB] - bodies.lastAngle[pair.bodyB];
+    return pair.normalA * w_a - pair.normalB * w_b;
+}
+
+/**
+ * Closing speed per step of @a deltaTime under which contacts rest
+ * g_restingThreshold fixed steps of gravity, as a speed, so the same
+ * impacts bounce whatever the step.
+ */
+inline float resting_speed(float deltaTime)
+{
+    return g_restingThreshold * BodyStore::gravity * g_fixedDeltaTime * deltaTime;
+}
+
+/**
+ * Set up @a pair for the velocity iterations
+ * Impacts faster than @a restingSpeed start from no impulse; resting
+ * contacts reapply what they accumulated last step when @a warm.
+ */
+inline void presolve_velocity(BodyStore& bodies, CollisionPair& pair, float restingSpeed, bool warm)
 {
-    for ( size_t i = 0; i < pairs.size(); i++ )
+    if ( closing_speed(bodies, pair) > restingSpeed || !warm )
     {
-        CollisionPair & pair = pairs[i];
-        Collision & collision = pair.collision;
-        PhysicsBody * BodyA = pair.bodyA;
-        PhysicsBody * BodyB = pair.bodyB;
+        pair.normalImpulse = 0.0f;
+        pair.tangentImpulse = 0.0f;
+        return;
     }
+
+    apply_impulse(bodies, pair, pair.normalImpulse, pair.tangentImpulse);
 }
 
-inline void solve_velocities(std::vector<CollisionPair>& pairs)
+/**
+ * One velocity iteration on @a pair
+ * Bodies closing faster than @a restingSpeed bounce off each other with
+ * the restitution. Every iteration runs in contact order, so an impact on
+ * a row of touching bodies is passed along the row one contact at a time
+ * like a cradle, rather than shared out between them. Slower contacts are
+ * stopped from closing; their accumulated impulse never pulls, and
+ * friction is bounded by it.
+ */
+inline void solve_velocity(BodyStore& bodies, CollisionPair& pair, float restingSpeed)
 {
-    for ( size_t i = 0; i < pairs.size(); i++ )
+    float closing = closing_speed(bodies, pair);
+
+    if ( closing > restingSpeed )
     {
-        PhysicsBody * bodyA = pairs[i].bodyA;
-        PhysicsBody * bodyB = pairs[i].bodyB;
+        apply_impulse(bodies, pair, (1 + BodyStore::restitution) * closing * pair.normalMass, 0.0f);
+        return;
+    }
 
-        bodyA->velocity = bodyA->position - bodyA->lastPosition;
-        bodyB->velocity = bodyB->position - bodyB->lastPosition;
+    float lambda = closing * pair.normalMass;
+    float normal = pair.normalImpulse + lambda;
+    if ( normal < 0 ) normal = 0.0f;
+    lambda = normal - pair.normalImpulse;
+    pair.normalImpulse = normal;
 
-        bodyA->angularVelocity = bodyA->angle - bodyA->lastAngle;
-        bodyB->angularVelocity = bodyB->angle - bodyB->lastAngle;
+    float friction = 0.0f;
+    if ( BodyStore::friction > 0 )
+    {
+        float w_a = bodies.angle[pair.bodyA] - bodies.lastAngle[pair.bodyA];
+        float w_b = bodies.angle[pair.bodyB] - bodies.lastAngle[pair.bodyB];
+        float sliding = pair.tangentA * w_a - pair.tangentB * w_b;
 
-        // for ( size_t j = 0; j < pair)
+        float limit = BodyStore::friction * normal;
+        float tangent = clamp(pair.tangentImpulse + sliding * pair.tangentMass, -limit, limit);
+        friction = tangent - pair.tangentImpulse;
+        pair.tangentImpulse = tangent;
     }
+
+    apply_impulse(bodies, pair, lambda, friction);
+}
+
+/**
+ * True if solving @a pair would leave it unchanged: neither body moves or
+ * carries an impulse, and they overlap no more than the slop.
+ */
+inline bool resting(const BodyStore& bodies, const CollisionPair& pair)
+{
+    uint32_t a = pair.bodyA;
+    uint32_t b = pair.bodyB;
+
+    return pair.collision.penetration <= CollisionPair::slop
+        && 0.0f == pair.normalImpulse
+        && 0.0f == pair.tangentImpulse
+        && 0.0f == bodies.angleImpulse[a]
+        && 0.0f == bodies.angleImpulse[b]
+        && bodies.angle[a] == bodies.lastAngle[a]
+        && bodies.angle[b] == bodies.lastAngle[b];
 }
 
+/** Speed at which the bodies of @a pair still close after solving. */
+inline float velocity_error(const BodyStore& bodies, const CollisionPair& pair)
+{
+    float error = closing_speed(bodies, pair);
+    return error > 0 ? error : 0.0f;
+}
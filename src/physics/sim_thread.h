@@ -0,0 +1,338 @@
+/*
+ * Copyright (c) 2015 Jonathan Howard
+ * License: https://github.com/v3n/altertum/blob/master/LICENSE
+ */
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+#include "core/job_system.h"
+#include "core/spsc_queue.h"
+#include "core/triple_buffer.h"
+
+#include "physics/body_store.h"
+#include "physics/clock.h"
+#include "physics/kernels.h"
+#include "physics/simulation.h"
+
+/** commands the render thread can queue between two simulation loops */
+static const size_t g_simCommandCapacity = 256;
+
+/** A change to the simulation, queued by the render thread. */
+struct SimCommand
+{
+    enum Type
+    {
+        /** Simulation::create_bodies() of count bodies */
+        CreateBodies,
+        /** Simulation::set_starting_angles() of degrees, left and right */
+        StartingAngles,
+        /** start or stop stepping */
+        Run,
+        /** switch Simulation::engine */
+        Engine,
+    };
+
+    Type             type;
+    uint32_t         count;
+    float            degrees;
+    uint32_t         left;
+    uint32_t         right;
+    bool             running;
+    StepEngine::Enum engine;
+
+    static inline SimCommand create_bodies(uint32_t count)
+    {
+        SimCommand c = { CreateBodies, count, 0.0f, 0, 0, false, StepEngine::Stepped };
+        return c;
+    }
+
+    static inline SimCommand starting_angles(float degrees, uint32_t left, uint32_t right)
+    {
+        SimCommand c = { StartingAngles, 0, degrees, left, right, false, StepEngine::Stepped };
+        return c;
+    }
+
+    static inline SimCommand run(bool running)
+    {
+        SimCommand c = { Run, 0, 0.0f, 0, 0, running, StepEngine::Stepped };
+        return c;
+    }
+
+    static inline SimCommand set_engine(StepEngine::Enum engine)
+    {
+        SimCommand c = { Engine, 0, 0.0f, 0, 0, false, engine };
+        return c;
+    }
+};
+
+/**
+ * What the render thread sees of the simulation, as of one loop
+ * Only the arrays render transforms read are copied; they keep their
+ * capacity, so publishing allocates only when the cradle grows.
+ */
+struct BodySnapshot
+{
+    std::vector<float> angle;
+    std::vector<float> lastAngle;
+    std::vector<float> pivotX;
+    std::vector<float> pivotY;
+    std::vector<float> pivotZ;
+
+    size_t   count;
+    size_t   awake;
+    /** steps taken since the thread started */
+    uint64_t steps;
+    bool     running;
+
+    /** fraction of a step in the accumulator when published */
+    float alpha;
+    /** step size of the simulation clock */
+    float deltaTime;
+    /** when it was published */
+    std::chrono::steady_clock::time_point time;
+
+    BodySnapshot()
+        : count(0)
+        , awake(0)
+        , steps(0)
+        , running(false)
+        , alpha(1.0f)
+        , deltaTime(g_fixedDeltaTime)
+    {
+    }
+
+    inline BodyPose pose() const
+    {
+        BodyPose p = { angle.data(), lastAngle.data(), pivotX.data(), pivotY.data(), pivotZ.data() };
+        return p;
+    }
+
+    /**
+     * Interpolation alpha at @a now, advanced from the published one by the
+     * time since and held at 1 until the next snapshot; 1 while stopped.
+     */
+    inline float alpha_at(std::chrono::steady_clock::time_point now) const
+    {
+        if ( !running ) return 1.0f;
+
+        float elapsed = std::chrono::duration<float>(now - time).count() * g_timeScale;
+        float a = alpha + elapsed / deltaTime;
+        return a < 1.0f ? a : 1.0f;
+    }
+
+    /**
+     * Render transforms of every body into @a out, as Simulation::transforms()
+     * Runs on the calling thread; the job system belongs to the simulation.
+     */
+    inline void transforms(float _alpha, const Vector3& offset, Matrix4* out) const
+    {
+        kernels::active().transforms(pose(), 0, count, _alpha, offset, out);
+    }
+};
+
+/**
+ * Simulation stepped on its own thread at its own rate
+ * The thread steps on a FixedTimestep against the wall clock and, after
+ * every loop that changed something, publishes a BodySnapshot through a
+ * triple buffer, so rendering reads the latest state without locks and a
+ * slow frame never holds up a step, or a slow step a frame. Inputs reach
+ * the simulation through a command queue; between start() and stop() only
+ * the thread touches the Simulation, its JobSystem and its ReplayLog.
+ */
+struct SimThread
+{
+    SimThread()
+        : simulation(NULL)
+        , jobs(NULL)
+        , quit(false)
+        , running(false)
+        , steps(0)
+    {
+    }
+
+    ~SimThread()
+    {
+        stop();
+    }
+
+    /**
+     * Start stepping @a _simulation, stopped, on a new thread
+     * @param _jobs optional, started on the simulation thread with
+     *              @a n_threads threads and shut down with it
+     */
+    inline void start(Simulation& _simulation, JobSystem* _jobs = NULL, size_t n_threads = 0)
+    {
+        stop();
+
+        simulation = &_simulation;
+        jobs = _jobs;
+        running = false;
+        steps = 0;
+        clock.init();
+
+        /* a first snapshot, so the first frame has something to draw */
+        publish(std::chrono::steady_clock::now());
+
+        quit.store(false);
+        thread = std::thread(&SimThread::main, this, n_threads);
+    }
+
+    /** Stop and join the thread, commands still queued are dropped. */
+    inline void stop()
+    {
+        if ( !thread.joinable() ) return;
+
+        quit.store(true, std::memory_order_release);
+        thread.join();
+
+        SimCommand command;
+        while ( commands.pop(command) ) {}
+    }
+
+    /**
+     * Render thread only, queue @a command for the next loop
+     * Waits while the queue is full, at most about one step.
+     */
+    inline void send(const SimCommand& command)
+    {
+        while ( !commands.push(command) )
+        {
+            std::this_thread::yield();
+        }
+    }
+
+    /** Render thread only, the latest snapshot, valid until the next call. */
+    inline const BodySnapshot& latest()
+    {
+        snapshots.acquire();
+        return snapshots.front();
+    }
+
+private:
+    SimThread(const SimThread&);
+    SimThread& operator=(const SimThread&);
+
+    inline void main(size_t n_threads)
+    {
+        /* parallel_for belongs to the thread that started the job system */
+        if ( NULL != jobs )
+        {
+            jobs->init(n_threads);
+            simulation->jobs = jobs;
+        }
+
+        std::chrono::steady_clock::time_point last = std::chrono::steady_clock::now();
+        while ( !quit.load(std::memory_order_acquire) )
+        {
+            bool changed = false;
+
+            SimCommand command;
+            while ( commands.pop(command) )
+            {
+                apply(command);
+                changed = true;
+            }
+
+            std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+            float frameTime = std::chrono::duration<float>(now - last).count() * g_timeScale;
+            last = now;
+
+            if ( running )
+            {
+                size_t n_steps = clock.advance(frameTime);
+                for ( size_t i = 0; i < n_steps; i++ )
+                {
+                    simulation->step(clock.deltaTime, 1.0f);
+                }
+                steps += n_steps;
+                changed |= n_steps > 0;
+            }
+            else
+            {
+                clock.reset();
+            }
+
+            if ( changed )
+            {
+                publish(now);
+            }
+
+            /* until the next step is due, so commands wait at most a step */
+            float wait = (clock.deltaTime - clock.accumulator) / g_timeScale;
+            std::this_thread::sleep_for(std::chrono::duration<float>(wait));
+        }
+
+        if ( NULL != jobs )
+        {
+            simulation->jobs = NULL;
+            jobs->shutdown();
+        }
+    }
+
+    inline void apply(const SimCommand& command)
+    {
+        switch ( command.type )
+        {
+            case SimCommand::CreateBodies:
+                simulation->create_bodies(command.count);
+                break;
+
+            case SimCommand::StartingAngles:
+                simulation->set_starting_angles(command.degrees, command.left, command.right);
+                break;
+
+            case SimCommand::Run:
+                running = command.running;
+                clock.reset();
+                break;
+
+            case SimCommand::Engine:
+                simulation->engine = command.engine;
+                break;
+        }
+    }
+
+    /** Copy what rendering needs into the back snapshot and hand it over. */
+    inline void publish(std::chrono::steady_clock::time_point now)
+    {
+        const BodyStore& bodies = simulation->bodies;
+        BodySnapshot& snapshot = snapshots.back();
+
+        size_t n = bodies.count;
+        snapshot.angle.assign(bodies.angle, bodies.angle + n);
+        snapshot.lastAngle.assign(bodies.lastAngle, bodies.lastAngle + n);
+        snapshot.pivotX.assign(bodies.constraintLoc.x, bodies.constraintLoc.x + n);
+        snapshot.pivotY.assign(bodies.constraintLoc.y, bodies.constraintLoc.y + n);
+        snapshot.pivotZ.assign(bodies.constraintLoc.z, bodies.constraintLoc.z + n);
+
+        snapshot.count     = n;
+        snapshot.awake     = simulation->awake_count();
+        snapshot.steps     = steps;
+        snapshot.running   = running;
+        snapshot.alpha     = clock.alpha();
+        snapshot.deltaTime = clock.deltaTime;
+        snapshot.time      = now;
+
+        snapshots.publish();
+    }
+
+    Simulation * simulation;
+    JobSystem *  jobs;
+
+    std::thread       thread;
+    std::atomic<bool> quit;
+
+    SpscQueue<SimCommand, g_simCommandCapacity> commands;
+    TripleBuffer<BodySnapshot>                  snapshots;
+
+    /* simulation thread only */
+    FixedTimestep clock;
+    bool          running;
+    uint64_t      steps;
+};
@@ -0,0 +1,1252 @@
+/*
+ * Copyright (c) 2015 Jonathan Howard
+ * License: https://github.com/v3n/altertum/blob/master/LICENSE
+ */
+
+#pragma once
+
+#include <cstdio>
+#include <vector>
+
+#include "core/frame_arena.h"
+#include "core/job_system.h"
+#include "core/mapped_file.h"
+
+#include "math/math_types.h"
+#include "math/vector3.h"
+
+#include "physics/entity.h"
+#include "physics/body_store.h"
+#include "physics/broadphase.h"
+#include "physics/coloring.h"
+#include "physics/event_cradle.h"
+#include "physics/islands.h"
+#include "physics/kernels.h"
+#include "physics/replay.h"
+#include "physics/resolver.h"
+#include "physics/snapshot.h"
+
+using namespace altertum;
+
+/** bodies per integration job, a multiple of BodyStore::lanes */
+static const size_t g_bodiesPerJob = 4096;
+/** contact pairs per resolution job */
+static const size_t g_pairsPerJob = 2048;
+
+/** Order contact pairs are resolved in. */
+struct ContactOrder
+{
+    enum Enum
+    {
+        /** pair order, one after the other */
+        Serial,
+        /** color batches in order, pairs of a batch in parallel */
+        Colored,
+        /** contact islands, each solved on its own and islands in parallel */
+        Islands,
+
+        Count
+    };
+};
+
+/** How a step advances the cradle. */
+struct StepEngine
+{
+    enum Enum
+    {
+        /** Verlet steps with contact resolution */
+        Stepped,
+        /** closed-form swings between predicted impacts, see event_cradle.h */
+        Events,
+
+        Count
+    };
+};
+
+/**
+ * @file simulation.h
+ * Render-free cradle state and physics step
+ * Shared by the interactive app and the headless tools
+ */
+struct Simulation
+{
+    BodyStore bodies;
+
+    BroadphaseType::Enum broadphaseType;
+    SpatialHash          grid;
+    SweepAndPrune        sweep;
+
+    /** candidate pairs from the last broadphase pass */
+    std::vector<CollisionPair> pairs;
+
+    /** optional, bodies are stepped on the calling thread when NULL */
+    JobSystem * jobs;
+
+    /** optional, inputs and steps are logged to it when set */
+    ReplayLog * replay;
+
+    StepEngine::Enum engine;
+    EventCradle      events;
+
+    /** swing integrator of the stepped engine */
+    SwingIntegrator::Enum integrator;
+
+    ContactOrder::Enum contactOrder;
+    ContactColoring    coloring;
+    ContactIslands     islands;
+
+    /** reapply the impulses resting contacts ended the last step with */
+    bool warmStarting;
+
+    /**
+     * Put bodies that stay still to sleep, sleeping bodies are not stepped
+     * Bodies asleep when this is cleared stay asleep until woken.
+     */
+    bool allowSleeping;
+
+    /** stop fast bodies where they first touch something within a step, see sweep_contacts() */
+    bool continuousCollision;
+    /** bodies stopped by sweep_contacts() since creation */
+    uint64_t sweptImpacts;
+
+    /** bodies per cradle, cradles are one empty slot apart; 0 for a single row */
+    size_t cradleSize;
+
+    /** pairs in contact during the last step, keeps its capacity */
+    std::vector<CollisionPair> active_collisions;
+
+    /** scratch memory for one step, emptied as each step starts */
+    FrameArena frame;
+
+    Simulation()
+        : broadphaseType(BroadphaseType::SweepAndPrune)
+        , jobs(NULL)
+        , replay(NULL)
+        , engine(StepEngine::Stepped)
+        , integrator(SwingIntegrator::Verlet)
+        , contactOrder(ContactOrder::Islands)
+        , warmStarting(true)
+        , allowSleeping(true)
+        , continuousCollision(true)
+        , sweptImpacts(0)
+        , cradleSize(0)
+        , pairs_from(BroadphaseType::Count)
+        , contacts(NULL)
+        , contact_offsets(NULL)
+        , contact_batches(0)
+        , awake_bodies(0)
+        , awake_dirty(true)
+        , events_ready(false)
+    {
+    }
+
+    /**
+     * Build a row of @a n_bodies pendulums, one unit apart, split into
+     * cradles of cradleSize
+     * At the default radius neighbors in a cradle just touch while hanging.
+     * Storage from an earlier call is reused, only growing if needed.
+     */
+    inline void create_bodies(  size_t n_bodies,
+                                float mass = 10.0f,
+                                float radius = 0.5f,
+                                float length = 2.25f
+                            )
+    {
+        if ( NULL != replay )
+        {
+            replay->set_config(replay_config());
+            replay->create_bodies((uint32_t)n_bodies, mass, radius, length);
+        }
+
+        build_bodies(n_bodies, radius, [&](BodyStore& store, size_t i)
+        {
+            size_t slot = i + (cradleSize > 0 ? i / cradleSize : 0);
+            Vector3 adjust = vector3::vector3(1.0f * slot, 0.0f, 0.0f);
+            store.init_body(i,
+                            adjust,
+                            mass,
+                            0.0f,
+                            radius,
+                            length
+                        );
+        });
+    }
+
+    /**
+     * Build @a n_bodies pendulums laid out by @a init, called as
+     * init(bodies, i) to BodyStore::init_body() each body
+     * @a max_radius is the largest radius of any of them, it sizes the grid.
+     * Not logged to replay, see create_bodies().
+     */
+    template <typename F>
+    inline void build_bodies(size_t n_bodies, float max_radius, const F& init)
+    {
+        bodies.resize(n_bodies);
+        grid.reset(2.0f * max_radius);
+        sweep.reset();
+        pairs_from = BroadphaseType::Count;
+        sweptImpacts = 0;
+
+        reserve(n_bodies);
+
+        for ( size_t i = 0; i < n_bodies; i++ )
+        {
+            init(bodies, i);
+        }
+
+        hang();
+        find_pairs();
+    }
+
+    /**
+     * Raise the outermost bodies to their starting angle
+     * @param degrees starting angle of the raised bodies
+     * @param left    number of bodies raised on the left side
+     * @param right   number of bodies raised on the right side
+     */
+    inline void set_starting_angles(float degrees, size_t left, size_t right)
+    {
+        if ( left  > bodies.count ) left  = bodies.count;
+        if ( right > bodies.count ) right = bodies.count;
+
+        if ( NULL != replay ) replay->starting_angles(degrees, (uint32_t)left, (uint32_t)right);
+
+        for ( size_t i = 0; i < bodies.count; i++ )
+        {
+            bodies.angle[i] = 0.0f;
+        }
+        for ( size_t i = 0; i < left; i++ )
+        {
+            bodies.angle[i] = degrees;
+        }
+        for ( size_t i = 0; i < right; i++ )
+        {
+            bodies.angle[bodies.count - 1 - i] = -degrees;
+        }
+
+        for ( size_t i = 0; i < bodies.count; i++ )
+        {
+            bodies.lastAngle[i] = bodies.angle[i];
+        }
+
+        hang();
+    }
+
+    /** Put every sphere at the end of its string, at rest, and wake it. */
+    inline void hang()
+    {
+        kernels::active().solve_constraint(bodies, 0, bodies.count);
+
+        for ( size_t i = 0; i < bodies.count; i++ )
+        {
+            bodies.lastPosition.set(i, bodies.position.get(i));
+            bodies.velocity.set(i, vector3::vector3(0.0f, 0.0f, 0.0f));
+            bodies.speed[i] = 0.0f;
+
+            bodies.sleepTime[i] = 0.0f;
+            bodies.sleeping[i] = 0;
+        }
+        awake_dirty = true;
+        events_ready = false;
+    }
+
+    /** Wake body @a i, bodies touching it wake with it on the next step. */
+    inline void wake(size_t i)
+    {
+        bodies.sleepTime[i] = 0.0f;
+        if ( bodies.sleeping[i] )
+        {
+            bodies.sleeping[i] = 0;
+            awake_dirty = true;
+        }
+    }
+
+    /** Swing body @a i @a degrees per step faster, waking it. */
+    inline void push(size_t i, float degrees)
+    {
+        if ( NULL != replay ) replay->push((uint32_t)i, degrees);
+
+        wake(i);
+        bodies.lastAngle[i] -= degrees;
+        events_ready = false;
+    }
+
+    /** Number of bodies that are not sleeping. */
+    inline size_t awake_count()
+    {
+        update_awake();
+        return awake_bodies;
+    }
+
+    /**
+     * Render angle of body @a i between the last two physics steps
+     * @param alpha fraction of a step elapsed since the latest one
+     */
+    inline float interpolated_angle(size_t i, float alpha) const
+    {
+        return bodies.lastAngle[i] + (bodies.angle[i] - bodies.lastAngle[i]) * alpha;
+    }
+
+    /** Render position of body @a i between the last two physics steps. */
+    inline Vector3 interpolated_position(size_t i, float alpha) const
+    {
+        Vector3 lastPosition = bodies.lastPosition.get(i);
+        return lastPosition + (bodies.position.get(i) - lastPosition) * alpha;
+    }
+
+    /**
+     * Render transform of every body between the last two physics steps,
+     * in one batch pass into @a out, bodies.count matrices
+     * Pivots are moved by @a offset into the scene.
+     */
+    inline void transforms(float alpha, const Vector3& offset, Matrix4* out) const
+    {
+        const Kernels& kernels = kernels::active();
+        BodyPose pose = bodies.pose();
+
+        auto place = [&](size_t begin, size_t end)
+        {
+            kernels.transforms(pose, begin, end, alpha, offset, out);
+        };
+
+        if ( NULL != jobs )
+        {
+            jobs->parallel_for(bodies.count, g_bodiesPerJob, place);
+        }
+        else
+        {
+            place(0, bodies.count);
+        }
+    }
+
+    /**
+     * Run the per-body chain over every awake body
+     * Each body only touches its own state, so ranges run in parallel
+     * when a job system is attached.
+     */
+    inline void integrate(float deltaTime, float correction)
+    {
+        const Kernels& kernels = kernels::active();
+        BodyStore& store = bodies;
+        SwingIntegrator::Enum method = integrator;
+
+        auto chain = [&](size_t begin, size_t end)
+        {
+            if ( SwingIntegrator::Verlet == method )
+            {
+                body_store::applyGravity(store, begin, end);
+                kernels.update(store, begin, end, deltaTime, correction);
+            }
+            else
+            {
+                kernels.swing(store, begin, end, deltaTime, correction, method);
+            }
+            kernels.solve_constraint(store, begin, end);
+            body_store::postsolve_constraint(store, begin, end);
+            body_store::clearForces(store, begin, end);
+        };
+
+        for_each_body(chain);
+    }
+
+    /**
+     * Rebuild the candidate pairs and their color batches
+     * Only pairs whose bounding boxes overlap are kept, so the narrowphase
+     * and the coloring scale with contacts rather than with bodies.
+     */
+    inline void find_pairs()
+    {
+        if ( BroadphaseType::Grid == broadphaseType )
+        {
+            /* the grid carries cached impulses over from its own sorted
+               output only */
+            if ( pairs_from != broadphaseType )
+            {
+                pairs.clear();
+                grid.reserve(bodies.count, pairs.capacity());
+            }
+            grid.update(bodies);
+            grid.find_pairs(bodies, pairs);
+        }
+        else
+        {
+            /* the sweep edits the pair list in place, start over if it
+               was last written by the grid */
+            if ( pairs_from != broadphaseType ) sweep.reset();
+            sweep.update(bodies, pairs);
+        }
+        pairs_from = broadphaseType;
+
+        if ( ContactOrder::Colored == contactOrder )
+        {
+            coloring.build(pairs, bodies.count);
+        }
+    }
+
+    /**
+     * Stop fast bodies where their sphere first meets another in the step
+     * A body moving over g_sweepMotion radii in a step could pass through a
+     * neighbor between two steps, or strike it so deep that the bounce is
+     * solved far from the contact. The broadphase bounds cover each sweep,
+     * so pairs with a fast body are tested for the first contact along it,
+     * and each body struck within the step is moved back to its earliest
+     * contact, with the rate it had there, for the contact solver to
+     * bounce. The rest of the step is dropped for those bodies rather than
+     * substepped.
+     * @param deltaTime time difference, sets the rates at the contacts
+     */
+    inline void sweep_contacts(float deltaTime)
+    {
+        /* taken every step, fast bodies or not, so the arena has grown to
+           hold it by the time one first appears */
+        float * first = frame.alloc_array<float>(bodies.count);
+
+        size_t n_fast = 0;
+        for ( size_t r = 0; r < awake_runs.size(); r += 2 )
+        {
+            for ( uint32_t i = awake_runs[r]; i < awake_runs[r + 1]; i++ )
+            {
+                if ( fast(i) ) n_fast++;
+            }
+        }
+        if ( 0 == n_fast ) return;
+
+        for ( size_t i = 0; i < bodies.count; i++ )
+        {
+            first[i] = 1.0f;
+        }
+
+        for ( size_t i = 0; i < pairs.size(); i++ )
+        {
+            uint32_t a = pairs[i].bodyA;
+            uint32_t b = pairs[i].bodyB;
+            if ( !fast(a) && !fast(b) ) continue;
+
+            float t = time_of_impact(bodies, pairs[i]);
+            if ( t < first[a] ) first[a] = t;
+            if ( t < first[b] ) first[b] = t;
+        }
+
+        for ( size_t i = 0; i < bodies.count; i++ )
+        {
+            if ( first[i] < 1.0f && !bodies.sleeping[i] )
+            {
+                body_store::rewind(bodies, i, first[i], deltaTime, integrator);
+                sweptImpacts++;
+            }
+        }
+    }
+
+    /**
+     * Run the narrowphase over every pair
+     * Fills each pair's contact and returns per-pair hit flags from the
+     * frame arena. Pairs are independent, so ranges run in parallel.
+     */
+    inline uint8_t* find_contacts()
+    {
+        const Kernels& kernels = kernels::active();
+        const BodyStore& store = bodies;
+        CollisionPair * pair_data = pairs.data();
+        uint8_t * hit = frame.alloc_array<uint8_t>(pairs.size());
+
+        auto test = [&](size_t begin, size_t end)
+        {
+            kernels.narrowphase(store, pair_data, begin, end, hit);
+        };
+
+        if ( NULL != jobs )
+        {
+            jobs->parallel_for(pairs.size(), g_pairsPerJob, test);
+        }
+        else
+        {
+            test(0, pairs.size());
+        }
+
+        return hit;
+    }
+
+    /**
+     * Run @a solve on every touching pair, in contactOrder
+     * Colored batches give the same result with or without a job system
+     * and for any thread count, since no two pairs of a batch share a body.
+     */
+    template <typename F>
+    inline void for_each_contact(const F& solve)
+    {
+        CollisionPair * pair_data = pairs.data();
+
+        for ( size_t c = 0; c < contact_batches; c++ )
+        {
+            const uint32_t * batch = &contacts[contact_offsets[c]];
+            size_t n = contact_offsets[c + 1] - contact_offsets[c];
+
+            auto range = [&](size_t begin, size_t end)
+            {
+                for ( size_t i = begin; i < end; i++ )
+                {
+                    solve(pair_data[batch[i]]);
+                }
+            };
+
+            bool overflow = coloring.overflow && c + 1 == coloring.batch_count();
+            if ( NULL != jobs && ContactOrder::Colored == contactOrder && !overflow )
+            {
+                jobs->parallel_for(n, g_pairsPerJob, range);
+            }
+            else
+            {
+                range(0, n);
+            }
+        }
+    }
+
+    /**
+     * Run @a chain over [begin, end) ranges of awake bodies
+     * Ranges are at most g_bodiesPerJob long and run in parallel when a
+     * job system is attached.
+     */
+    template <typename F>
+    inline void for_each_body(const F& chain)
+    {
+        update_awake();
+
+        const uint32_t * runs = awake_runs.data();
+        size_t n_runs = awake_runs.size() / 2;
+
+        auto range = [&](size_t begin, size_t end)
+        {
+            for ( size_t r = begin; r < end; r++ )
+            {
+                chain(runs[2 * r], runs[2 * r + 1]);
+            }
+        };
+
+        if ( NULL != jobs && n_runs > 0 )
+        {
+            size_t grain = n_runs * g_bodiesPerJob / awake_bodies;
+            jobs->parallel_for(n_runs, grain > 0 ? grain : 1, range);
+        }
+        else
+        {
+            range(0, n_runs);
+        }
+    }
+
+    /**
+     * Run @a solve(k, contacts, n) on each island k with work to do
+     * Islands share no body, so they run in parallel, in jobs of about
+     * g_pairsPerJob contacts. Islands flagged in @a idle are skipped.
+     */
+    template <typename F>
+    inline void for_each_island(const uint8_t* idle, const F& solve)
+    {
+        const uint32_t * island_contacts = contacts;
+        const uint32_t * offsets = contact_offsets;
+
+        auto range = [&](size_t begin, size_t end)
+        {
+            for ( size_t k = begin; k < end; k++ )
+            {
+                if ( NULL == idle || !idle[k] ) solve(k, &island_contacts[offsets[k]], offsets[k + 1] - offsets[k]);
+            }
+        };
+
+        if ( NULL != jobs && contact_batches > 0 )
+        {
+            size_t n_contacts = offsets[contact_batches];
+            size_t grain = n_contacts > 0 ? (contact_batches * g_pairsPerJob + n_contacts - 1) / n_contacts : 1;
+            jobs->parallel_for(contact_batches, grain, range);
+        }
+        else
+        {
+            range(0, contact_batches);
+        }
+    }
+
+    /**
+     * Solve every touching pair
+     * Position iterations push overlapping spheres apart, then velocity
+     * iterations bounce impacts and keep resting contacts from closing.
+     * @param deltaTime time difference, sets the resting speed
+     */
+    inline void resolve_contacts(float deltaTime)
+    {
+        uint8_t * pair_active = find_contacts();
+
+        if ( ContactOrder::Islands == contactOrder || allowSleeping )
+        {
+            islands.build(pairs, pair_active, bodies.count);
+        }
+        if ( allowSleeping ) wake_islands();
+
+        collect_contacts(pair_active);
+
+        const Kernels& kernels = kernels::active();
+        BodyStore& store = bodies;
+        CollisionPair * pair_data = pairs.data();
+        bool warm = warmStarting;
+        float restingSpeed = resting_speed(deltaTime);
+
+        auto postsolve = [&](size_t begin, size_t end)
+        {
+            postsolve_positions(store, begin, end);
+            kernels.solve_constraint(store, begin, end);
+        };
+
+        if ( ContactOrder::Islands == contactOrder )
+        {
+            /* the solver would leave an island at rest unchanged, so it is
+               skipped, as are sleeping islands */
+            uint8_t * idle = frame.alloc_array<uint8_t>(contact_batches);
+
+            for_each_island(NULL, [&](size_t k, const uint32_t* island, size_t n)
+            {
+                bool at_rest = 0 != store.sleeping[pair_data[island[0]].bodyA];
+                for ( size_t i = 0; i < n && at_rest; i++ ) at_rest = resting(store, pair_data[island[i]]);
+
+                idle[k] = at_rest ? 1 : 0;
+                if ( at_rest ) return;
+
+                for ( size_t i = 0; i < n; i++ ) presolve_position(store, pair_data[island[i]]);
+                for ( size_t times = 0; times < g_positionIterations; times++ )
+                {
+                    for ( size_t i = 0; i < n; i++ ) solve_position(store, pair_data[island[i]]);
+                }
+            });
+
+            for_each_body(postsolve);
+
+            for_each_island(idle, [&](size_t, const uint32_t* island, size_t n)
+            {
+                for ( size_t i = 0; i < n; i++ ) presolve_velocity(store, pair_data[island[i]], restingSpeed, warm);
+
+                for ( size_t times = 0; times < g_velocityIterations; times++ )
+                {
+                    for ( size_t i = 0; i < n; i++ ) solve_velocity(store, pair_data[island[i]], restingSpeed);
+                }
+            });
+        }
+        else
+        {
+            for_each_contact([&](CollisionPair& pair) { presolve_position(store, pair); });
+            for ( size_t times = 0; times < g_positionIterations; times++ )
+            {
+                for_each_contact([&](CollisionPair& pair) { solve_position(store, pair); });
+            }
+
+            for_each_body(postsolve);
+
+            for_each_contact([&](CollisionPair& pair) { presolve_velocity(store, pair, restingSpeed, warm); });
+            for ( size_t times = 0; times < g_velocityIterations; times++ )
+            {
+                for_each_contact([&](CollisionPair& pair) { solve_velocity(store, pair, restingSpeed); });
+            }
+        }
+
+        active_collisions.clear();
+        for ( size_t i = 0; i < pairs.size(); i++ )
+        {
+            if ( pair_active[i] )
+            {
+                active_collisions.push_back(pairs[i]);
+            }
+        }
+    }
+
+    /** Largest closing speed left on a contact of the last step, see velocity_error(). */
+    inline float contact_error() const
+    {
+        float worst = 0.0f;
+        for ( size_t i = 0; i < active_collisions.size(); i++ )
+        {
+            float error = velocity_error(bodies, active_collisions[i]);
+            if ( error > worst ) worst = error;
+        }
+        return worst;
+    }
+
+    /**
+     * Put bodies to sleep that have been still for g_sleepTime
+     * An island only sleeps once all of its bodies are still, and sleeps
+     * with no impulse left on its contacts.
+     * @param deltaTime time difference, sets the still speed
+     */
+    inline void settle(float deltaTime)
+    {
+        BodyStore& store = bodies;
+        float stillSpeed = g_sleepSpeed * resting_speed(deltaTime);
+
+        for_each_body([&](size_t begin, size_t end)
+        {
+            body_store::track_rest(store, begin, end, deltaTime, stillSpeed);
+        });
+
+        for ( size_t k = 0; k < islands.island_count(); k++ )
+        {
+            size_t begin = islands.offsets[k];
+            size_t end   = islands.offsets[k + 1];
+
+            bool ready = true;
+            for ( size_t i = begin; i < end && ready; i++ )
+            {
+                const CollisionPair& pair = pairs[islands.order[i]];
+                ready = still(pair.bodyA) && still(pair.bodyB);
+            }
+            if ( !ready ) continue;
+
+            for ( size_t i = begin; i < end; i++ )
+            {
+                CollisionPair& pair = pairs[islands.order[i]];
+                pair.normalImpulse = 0.0f;
+                pair.tangentImpulse = 0.0f;
+
+                sleep(pair.bodyA);
+                sleep(pair.bodyB);
+            }
+        }
+
+        /* the runs stay valid while bodies fall asleep, until the next
+           update_awake() */
+        for ( size_t r = 0; r < awake_runs.size(); r += 2 )
+        {
+            for ( uint32_t i = awake_runs[r]; i < awake_runs[r + 1]; i++ )
+            {
+                if ( still(i) && !islands.contains(i) ) sleep(i);
+            }
+        }
+    }
+
+    /**
+     * Advance the cradle by @a deltaTime with the event engine
+     * The engine takes over the bodies as they are on its first step, or
+     * after they were changed from outside.
+     */
+    inline void step_events(float deltaTime)
+    {
+        if ( !events_ready )
+        {
+            events.reset(bodies, deltaTime);
+            events_ready = true;
+        }
+
+        events.advance(deltaTime);
+
+        const Kernels& kernels = kernels::active();
+        const EventCradle& cradle = events;
+        BodyStore& store = bodies;
+
+        auto place = [&](size_t begin, size_t end)
+        {
+            cradle.sample(store, begin, end);
+            kernels.solve_constraint(store, begin, end);
+        };
+
+        if ( NULL != jobs )
+        {
+            jobs->parallel_for(bodies.count, g_bodiesPerJob, place);
+        }
+        else
+        {
+            place(0, bodies.count);
+        }
+    }
+
+    /**
+     * Advance every awake body and resolve contacts, or hand the step to
+     * the event engine
+     * @param deltaTime  time difference
+     * @param correction deltaTime / lastDeltaTime
+     */
+    inline void step(float deltaTime, float correction)
+    {
+        if ( NULL != replay )
+        {
+            replay->set_config(replay_config());
+            replay->step(deltaTime, correction);
+        }
+
+        if ( StepEngine::Events == engine )
+        {
+            step_events(deltaTime);
+            return;
+        }
+
+        events_ready = false;
+        frame.reset();
+
+        integrate(deltaTime, correction);
+
+        find_pairs();
+        if ( continuousCollision ) sweep_contacts(deltaTime);
+        resolve_contacts(deltaTime);
+
+        if ( allowSleeping ) settle(deltaTime);
+    }
+
+    /** Settings a step depends on, as logged to a replay. */
+    inline ReplayConfig replay_config() const
+    {
+        ReplayConfig config;
+        memset(&config, 0, sizeof(config));
+
+        config.engine       = (uint8_t)engine;
+        config.integrator   = (uint8_t)integrator;
+        config.contactOrder = (uint8_t)contactOrder;
+        config.broadphase   = (uint8_t)broadphaseType;
+        config.kernels      = (uint8_t)kernels::active().set;
+        config.cradleSize   = (uint32_t)cradleSize;
+
+        if ( warmStarting )        config.flags |= ReplayConfig::WarmStarting;
+        if ( allowSleeping )       config.flags |= ReplayConfig::AllowSleeping;
+        if ( continuousCollision ) config.flags |= ReplayConfig::ContinuousCollision;
+
+        return config;
+    }
+
+    /**
+     * Run @a log from the start, at full speed
+     * The kernels it was recorded with are selected, since the SIMD sets
+     * round sines and cosines differently. Returns false if those are not
+     * supported here, the log is malformed, or the state differs from a
+     * hash logged along the way; the state is left where playback stopped.
+     */
+    inline bool play(const ReplayLog& log)
+    {
+        ReplayLog * recording = replay;
+        replay = NULL;
+
+        bool ok = true;
+        size_t offset = 0;
+        ReplayEntry entry;
+
+        while ( ok && offset < log.data.size() )
+        {
+            ok = log.read(offset, entry);
+            if ( !ok ) break;
+
+            switch ( entry.type )
+            {
+                case ReplayRecord::Config:
+                    ok = apply_config(entry.config);
+                    break;
+                case ReplayRecord::CreateBodies:
+                    create_bodies(entry.count, entry.mass, entry.radius, entry.length);
+                    break;
+                case ReplayRecord::StartingAngles:
+                    set_starting_angles(entry.degrees, entry.left, entry.right);
+                    break;
+                case ReplayRecord::Push:
+                    ok = entry.index < bodies.count;
+                    if ( ok ) push(entry.index, entry.degrees);
+                    break;
+                case ReplayRecord::Steps:
+                    for ( uint32_t i = 0; i < entry.count; i++ ) step(entry.deltaTime, entry.correction);
+                    break;
+                case ReplayRecord::Hash:
+                    ok = entry.hash == body_store::state_hash(bodies);
+                    break;
+                default:
+                    ok = false;
+                    break;
+            }
+        }
+
+        replay = recording;
+        return ok;
+    }
+
+    /**
+     * Write everything a step depends on to a snapshot at @a path
+     * Returns false if the file cannot be written. Under the event engine
+     * the swings are not saved; a restored cradle starts them over from
+     * the bodies.
+     */
+    inline bool save(const char* path) const
+    {
+        std::vector<SnapshotPair> saved(pairs.size());
+        for ( size_t i = 0; i < pairs.size(); i++ )
+        {
+            saved[i].bodyA          = pairs[i].bodyA;
+            saved[i].bodyB          = pairs[i].bodyB;
+            saved[i].normalImpulse  = pairs[i].normalImpulse;
+            saved[i].tangentImpulse = pairs[i].tangentImpulse;
+        }
+
+        /* the grid keeps nothing a rebuild would not give back */
+        bool sweeping = BroadphaseType::SweepAndPrune == pairs_from;
+        std::vector<uint32_t> order(sweeping ? sweep.endpoint_count() : 0);
+        for ( size_t i = 0; i < order.size(); i++ )
+        {
+            order[i] = sweep.endpoint_id(i);
+        }
+
+        SnapshotHeader header;
+        memset(&header, 0, sizeof(header));
+
+        header.magic      = g_snapshotMagic;
+        header.version    = g_snapshotVersion;
+        header.headerSize = sizeof(SnapshotHeader);
+        header.byteOrder  = g_snapshotByteOrder;
+        header.fieldCount = (uint32_t)BodyStore::field_count();
+        header.pairSize   = sizeof(SnapshotPair);
+        header.count      = bodies.count;
+        header.capacity   = bodies.capacity;
+
+        header.bodiesOffset    = snapshot_align(sizeof(SnapshotHeader));
+        header.bodiesSize      = bodies.block_size();
+        header.pairsOffset     = snapshot_align(header.bodiesOffset + header.bodiesSize);
+        header.pairCount       = saved.size();
+        header.endpointsOffset = snapshot_align(header.pairsOffset + saved.size() * sizeof(SnapshotPair));
+        header.endpointCount   = order.size();
+
+        header.config       = replay_config();
+        header.pairsFrom    = (uint32_t)pairs_from;
+        header.cellSize     = grid.cellSize;
+        header.sweptImpacts = sweptImpacts;
+
+        FILE* file = fopen(path, "wb");
+        if ( NULL == file ) return false;
+
+        uint64_t at = 0;
+        bool ok = write_section(file, at, 0, &header, sizeof(header))
+               && write_section(file, at, header.bodiesOffset, bodies.block(), header.bodiesSize)
+               && write_section(file, at, header.pairsOffset, saved.data(), saved.size() * sizeof(SnapshotPair))
+               && write_section(file, at, header.endpointsOffset, order.data(), order.size() * sizeof(uint32_t));
+
+        return 0 == fclose(file) && ok;
+    }
+
+    /**
+     * Continue from the snapshot at @a path
+     * The file is mapped copy-on-write and the bodies use their section
+     * in place, so restoring costs the pairs alone and pages are read as
+     * steps touch them; any number of simulations can fork from one
+     * snapshot this way. Stepping on then matches the run that saved it
+     * bit-for-bit. Returns false, leaving the simulation as it was, if
+     * the file is not a snapshot of this version and layout or its
+     * kernels are not supported here.
+     */
+    inline bool restore(const char* path)
+    {
+        MappedFile file;
+        if ( !file.open(path) || file.size < sizeof(SnapshotHeader) ) return false;
+
+        SnapshotHeader header;
+        memcpy(&header, file.data, sizeof(header));
+
+        bool ok = g_snapshotMagic == header.magic
+               && g_snapshotVersion == header.version
+               && sizeof(SnapshotHeader) == header.headerSize
+               && g_snapshotByteOrder == header.byteOrder
+               && BodyStore::field_count() == header.fieldCount
+               && sizeof(SnapshotPair) == header.pairSize
+               && header.count <= header.capacity
+               && 0 == header.capacity % BodyStore::lanes
+               && header.capacity <= file.size / sizeof(float)
+               && BodyStore::array_size(header.capacity) * BodyStore::field_count() == header.bodiesSize
+               && 0 == header.bodiesOffset % g_snapshotAlignment
+               && snapshot_fits(file.size, header.bodiesOffset, header.bodiesSize, 1)
+               && 0 == header.pairsOffset % alignof(SnapshotPair)
+               && snapshot_fits(file.size, header.pairsOffset, header.pairCount, sizeof(SnapshotPair))
+               && 0 == header.endpointsOffset % alignof(uint32_t)
+               && snapshot_fits(file.size, header.endpointsOffset, header.endpointCount, sizeof(uint32_t))
+               && (0 == header.endpointCount || 2 * header.count == header.endpointCount)
+               && header.pairsFrom <= BroadphaseType::Count
+               && snapshot_indices_valid(file.data, header);
+
+        ReplayConfig previous = replay_config();
+        if ( !ok || !apply_config(header.config) )
+        {
+            apply_config(previous);
+            return false;
+        }
+
+        bodies.attach(file.data + header.bodiesOffset, header.count, header.capacity);
+        mapping.swap(file);
+
+        reserve(header.count);
+
+        const SnapshotPair * saved = (const SnapshotPair *)(mapping.data + header.pairsOffset);
+        pairs.resize(header.pairCount);
+        for ( size_t i = 0; i < header.pairCount; i++ )
+        {
+            pairs[i] = CollisionPair();
+            pairs[i].bodyA          = saved[i].bodyA;
+            pairs[i].bodyB          = saved[i].bodyB;
+            pairs[i].normalImpulse  = saved[i].normalImpulse;
+            pairs[i].tangentImpulse = saved[i].tangentImpulse;
+        }
+
+        grid.reset(header.cellSize);
+        sweep.reset();
+        if ( header.endpointCount > 0 )
+        {
+            sweep.restore((const uint32_t *)(mapping.data + header.endpointsOffset), header.endpointCount, pairs);
+        }
+
+        pairs_from   = (BroadphaseType::Enum)header.pairsFrom;
+        sweptImpacts = header.sweptImpacts;
+        awake_dirty  = true;
+        events_ready = false;
+
+        return true;
+    }
+
+private:
+    Simulation(const Simulation&);
+    Simulation& operator=(const Simulation&);
+
+    /**
+     * True if every pair and sweep endpoint of the snapshot @a data names
+     * one of its bodies, so none of them indexes past the body arrays
+     * The sections must already be known to lie within the file.
+     */
+    static inline bool snapshot_indices_valid(const uint8_t* data, const SnapshotHeader& header)
+    {
+        const SnapshotPair * saved = (const SnapshotPair *)(data + header.pairsOffset);
+        for ( size_t i = 0; i < header.pairCount; i++ )
+        {
+            if ( saved[i].bodyA >= header.count || saved[i].bodyB >= header.count ) return false;
+        }
+
+        const uint32_t * ids = (const uint32_t *)(data + header.endpointsOffset);
+        for ( size_t i = 0; i < header.endpointCount; i++ )
+        {
+            if ( (ids[i] >> 1) >= header.count ) return false;
+        }
+        return true;
+    }
+
+    /**
+     * Bytes of frame arena a step takes out with @a n_pairs pairs between
+     * @a n_bodies bodies, all held at once: the pair hit flags, the first
+     * contact time of every body for the sweep, and the larger of the idle
+     * flag per island and the batch index arrays, each padded to 16.
+     */
+    static inline size_t frame_bytes(size_t n_bodies, size_t n_pairs)
+    {
+        size_t hit     = n_pairs * sizeof(uint8_t);
+        size_t first   = n_bodies * sizeof(float);
+        size_t idle    = n_pairs * sizeof(uint8_t);
+        size_t batches = (n_pairs + ContactColoring::max_colors + 2) * sizeof(uint32_t);
+        return hit + first + (idle > batches ? idle : batches) + 4 * 16;
+    }
+
+    /**
+     * Make room for the pairs and scratch of @a n_bodies bodies, so stepping
+     * does not allocate
+     * Only the broadphase in use is set up; the grid's cell lists are the
+     * bulk of it.
+     */
+    inline void reserve(size_t n_bodies)
+    {
+        /* bodies in a row touch about one neighbor each; reserve twice that
+           plus slack so stepping does not allocate when contacts appear */
+        size_t n_pairs = 2 * n_bodies + 64;
+        pairs.reserve(n_pairs);
+        active_collisions.reserve(n_pairs);
+        if ( BroadphaseType::Grid == broadphaseType ) grid.reserve(n_bodies, n_pairs);
+        sweep.reserve(n_bodies, n_pairs);
+        coloring.reserve(n_pairs, n_bodies);
+        islands.reserve(n_pairs, n_bodies);
+        frame.reserve(frame_bytes(n_bodies, n_pairs));
+        /* every other body asleep is the most runs there can be */
+        awake_runs.reserve(n_bodies + 2 * (n_bodies / g_bodiesPerJob) + 4);
+    }
+
+    /**
+     * Write @a bytes of @a data at @a offset of @a file, padding with zeros
+     * from @a at, the bytes written so far
+     */
+    static inline bool write_section(FILE* file, uint64_t& at, uint64_t offset, const void* data, size_t bytes)
+    {
+        if ( at > offset ) return false;
+
+        for ( ; at < offset; at++ )
+        {
+            if ( EOF == fputc(0, file) ) return false;
+        }
+
+        at += bytes;
+        return 0 == bytes || 1 == fwrite(data, bytes, 1, file);
+    }
+
+    /** Take the settings of a replay, returns false if its kernels are not supported. */
+    inline bool apply_config(const ReplayConfig& config)
+    {
+        if ( config.engine >= StepEngine::Count || config.integrator >= SwingIntegrator::Count
+          || config.contactOrder >= ContactOrder::Count || config.broadphase >= BroadphaseType::Count
+          || config.kernels >= KernelSet::Count )
+        {
+            return false;
+        }
+
+        engine         = (StepEngine::Enum)config.engine;
+        integrator     = (SwingIntegrator::Enum)config.integrator;
+        contactOrder   = (ContactOrder::Enum)config.contactOrder;
+        broadphaseType = (BroadphaseType::Enum)config.broadphase;
+        cradleSize     = config.cradleSize;
+
+        warmStarting        = 0 != (config.flags & ReplayConfig::WarmStarting);
+        allowSleeping       = 0 != (config.flags & ReplayConfig::AllowSleeping);
+        continuousCollision = 0 != (config.flags & ReplayConfig::ContinuousCollision);
+
+        return kernels::select((KernelSet::Enum)config.kernels);
+    }
+
+    /** True if body @a i moved far enough last step to be swept. */
+    inline bool fast(uint32_t i) const
+    {
+        return !bodies.sleeping[i] && bodies.speed[i] > g_sweepMotion * bodies.radius[i];
+    }
+
+    /** True if awake body @a i has been still long enough to sleep. */
+    inline bool still(uint32_t i) const
+    {
+        return !bodies.sleeping[i] && bodies.sleepTime[i] >= g_sleepTime;
+    }
+
+    /** Stop body @a i where it is. */
+    inline void sleep(uint32_t i)
+    {
+        if ( bodies.sleeping[i] ) return;
+
+        bodies.sleeping[i] = 1;
+        bodies.lastAngle[i] = bodies.angle[i];
+        bodies.angleImpulse[i] = 0.0f;
+        bodies.angularVelocity[i] = 0.0f;
+        bodies.angularSpeed[i] = 0.0f;
+
+        bodies.lastPosition.set(i, bodies.position.get(i));
+        bodies.velocity.set(i, vector3::vector3(0.0f, 0.0f, 0.0f));
+        bodies.speed[i] = 0.0f;
+
+        awake_dirty = true;
+    }
+
+    /** Wake the sleeping bodies of every island that also holds an awake body. */
+    inline void wake_islands()
+    {
+        for ( size_t k = 0; k < islands.island_count(); k++ )
+        {
+            size_t begin = islands.offsets[k];
+            size_t end   = islands.offsets[k + 1];
+
+            bool asleep = false;
+            bool awake  = false;
+            for ( size_t i = begin; i < end && !(asleep && awake); i++ )
+            {
+                const CollisionPair& pair = pairs[islands.order[i]];
+                asleep = asleep || bodies.sleeping[pair.bodyA] || bodies.sleeping[pair.bodyB];
+                awake  = awake || !bodies.sleeping[pair.bodyA] || !bodies.sleeping[pair.bodyB];
+            }
+            if ( !(asleep && awake) ) continue;
+
+            for ( size_t i = begin; i < end; i++ )
+            {
+                wake(pairs[islands.order[i]].bodyA);
+                wake(pairs[islands.order[i]].bodyB);
+            }
+        }
+    }
+
+    /** Rebuild the runs of awake bodies if bodies fell asleep or woke. */
+    inline void update_awake()
+    {
+        if ( !awake_dirty ) return;
+        awake_dirty = false;
+
+        awake_runs.clear();
+        awake_bodies = 0;
+
+        size_t i = 0;
+        while ( i < bodies.count )
+        {
+            if ( bodies.sleeping[i] )
+            {
+                i++;
+                continue;
+            }
+
+            size_t begin = i;
+            while ( i < bodies.count && !bodies.sleeping[i] && i - begin < g_bodiesPerJob ) i++;
+
+            awake_runs.push_back((uint32_t)begin);
+            awake_runs.push_back((uint32_t)i);
+            awake_bodies += i - begin;
+        }
+    }
+
+    /**
+     * Gather the touching pairs of @a pair_active into batches
+     * One batch in pair order when serial, the touching pairs of each color
+     * batch when colored, or one batch per island. Sleeping pairs are left
+     * out of the serial and colored batches; pairs out of contact drop
+     * their cached impulses.
+     */
+    inline void collect_contacts(const uint8_t* pair_active)
+    {
+        if ( ContactOrder::Islands == contactOrder )
+        {
+            contacts = islands.order.data();
+            contact_offsets = islands.offsets.data();
+            contact_batches = islands.island_count();
+        }
+        else
+        {
+            bool colored = ContactOrder::Colored == contactOrder;
+            size_t n_batches = colored ? coloring.batch_count() : 1;
+
+            uint32_t * batches = frame.alloc_array<uint32_t>(pairs.size());
+            uint32_t * offsets = frame.alloc_array<uint32_t>(n_batches + 1);
+
+            uint32_t n = 0;
+            for ( size_t c = 0; c < n_batches; c++ )
+            {
+                offsets[c] = n;
+
+                size_t begin = colored ? coloring.offsets[c] : 0;
+                size_t end   = colored ? coloring.offsets[c + 1] : pairs.size();
+                for ( size_t i = begin; i < end; i++ )
+                {
+                    uint32_t p = colored ? coloring.order[i] : (uint32_t)i;
+                    if ( pair_active[p] && !bodies.sleeping[pairs[p].bodyA] ) batches[n++] = p;
+                }
+            }
+            offsets[n_batches] = n;
+
+            contacts = batches;
+            contact_offsets = offsets;
+            contact_batches = n_batches;
+        }
+
+        for ( size_t i = 0; i < pairs.size(); i++ )
+        {
+            if ( !pair_active[i] )
+            {
+                pairs[i].normalImpulse = 0.0f;
+                pairs[i].tangentImpulse = 0.0f;
+            }
+        }
+    }
+
+    /** broadphase that produced pairs */
+    BroadphaseType::Enum pairs_from;
+
+    /** touching pair indices of the current step by batch, in the frame arena */
+    const uint32_t * contacts;
+    const uint32_t * contact_offsets;
+    size_t           contact_batches;
+
+    /** [begin, end) runs of awake bodies, at most g_bodiesPerJob long */
+    std::vector<uint32_t> awake_runs;
+    size_t                awake_bodies;
+    bool                  awake_dirty;
+
+    /** events holds the current state of the bodies */
+    bool events_ready;
+
+    /** snapshot the bodies live in after restore(), until they outgrow it */
+    MappedFile mapping;
+};
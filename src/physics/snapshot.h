@@ -0,0 +1,82 @@
+/*
+ * Copyright (c) 2015 Jonathan Howard
+ * License: https://github.com/v3n/altertum/blob/master/LICENSE
+ */
+
+#pragma once
+
+#include <cstdint>
+
+#include "physics/replay.h"
+
+/** first bytes of a snapshot, and its format version */
+static const uint32_t g_snapshotMagic   = 0x50534352; // "RCSP"
+static const uint32_t g_snapshotVersion = 1;
+/** written as is, reads back the same only in the byte order it was written in */
+static const uint32_t g_snapshotByteOrder = 0x01020304;
+/** sections start on page boundaries, so mapped arrays keep BodyStore::alignment */
+static const uint64_t g_snapshotAlignment = 4096;
+
+/**
+ * @file snapshot.h
+ * Fixed-layout binary snapshot of a Simulation
+ * The header is followed by sections, each at an offset aligned to
+ * g_snapshotAlignment:
+ *  - bodies, BodyStore::block() as is, so a mapped snapshot is used in
+ *    place (see BodyStore::attach())
+ *  - pairs, the state a CollisionPair keeps from one step to the next
+ *  - endpoints, the sorted order of the sweep and prune endpoints
+ * Everything else a step needs is rebuilt from these on the next step.
+ * See Simulation::save() and Simulation::restore().
+ */
+struct SnapshotHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t headerSize;
+    uint32_t byteOrder;
+
+    /** BodyStore layout */
+    uint32_t fieldCount;
+    uint32_t pairSize;
+    uint64_t count;
+    uint64_t capacity;
+
+    uint64_t bodiesOffset;
+    uint64_t bodiesSize;
+    uint64_t pairsOffset;
+    uint64_t pairCount;
+    uint64_t endpointsOffset;
+    uint64_t endpointCount;
+
+    /** Simulation state outside the bodies */
+    ReplayConfig config;
+    uint32_t     pairsFrom;
+    float        cellSize;
+    uint32_t     padding;
+    uint64_t     sweptImpacts;
+};
+
+/** What a CollisionPair carries over between steps */
+struct SnapshotPair
+{
+    uint32_t bodyA;
+    uint32_t bodyB;
+    float    normalImpulse;
+    float    tangentImpulse;
+};
+
+/**
+ * True if @a count items of @a size bytes from @a offset lie within a
+ * file of @a file_size bytes; hostile values cannot overflow the test.
+ */
+inline bool snapshot_fits(uint64_t file_size, uint64_t offset, uint64_t count, uint64_t size)
+{
+    return offset <= file_size && count <= (file_size - offset) / size;
+}
+
+/** Offset @a offset rounded up to the next section boundary. */
+inline uint64_t snapshot_align(uint64_t offset)
+{
+    return (offset + g_snapshotAlignment - 1) & ~(g_snapshotAlignment - 1);
+}
@@ -0,0 +1,508 @@
+/*
+ * Copyright (c) 2015 Jonathan Howard
+ * License: https://github.com/v3n/altertum/blob/master/LICENSE
+ */
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "physics/body_store.h"
+
+/** first and last bytes of a trajectory file, and its format version */
+static const uint32_t g_trajectoryMagic   = 0x4a544352; // "RCTJ"
+static const uint32_t g_trajectoryVersion = 1;
+/** recorded values per body and frame: angle, position x, y and z */
+static const size_t g_trajectoryChannels = 4;
+/** resolution of recorded angles, in degrees */
+static const float g_trajectoryAngleStep = 1e-3f;
+/** resolution of recorded positions, a hundredth of a millimeter */
+static const float g_trajectoryPositionStep = 1e-4f;
+/** frames per chunk, each chunk decodes on its own */
+static const uint32_t g_trajectoryChunkFrames = 64;
+/** memory for frames the sim thread can be ahead of the writer, before frames are dropped */
+static const size_t g_trajectoryRingBytes = 64 << 20;
+/** bounds on the frames that buffer holds, whatever the body count */
+static const size_t g_trajectoryRingMinFrames = 4;
+static const size_t g_trajectoryRingMaxFrames = 4096;
+
+/**
+ * @file trajectory.h
+ * Per-step body trajectories, compressed and written in the background
+ * Every frame is quantized to a fixed grid (g_trajectoryAngleStep and
+ * g_trajectoryPositionStep) and stored as the difference to the frame
+ * before, as zigzag varints, so bodies that barely move cost a byte per
+ * value. The first frame of a chunk is stored against zero, and an index
+ * of chunks at the end of the file lets readers seek to any step.
+ *
+ * File layout, all little-endian:
+ *  - TrajectoryHeader
+ *  - chunks, each a run of frames: varint step, then per channel the
+ *    varint deltas of every body
+ *  - TrajectoryChunk index entries, one per chunk
+ *  - TrajectoryFooter
+ */
+
+struct TrajectoryHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint64_t bodies;
+    uint32_t channels;
+    uint32_t chunkFrames;
+    float    angleStep;
+    float    positionStep;
+};
+
+struct TrajectoryChunk
+{
+    uint64_t firstStep;
+    uint64_t offset;
+    uint32_t bytes;
+    uint32_t frames;
+};
+
+struct TrajectoryFooter
+{
+    uint64_t indexOffset;
+    uint64_t chunks;
+    uint32_t magic;
+    uint32_t padding;
+};
+
+namespace trajectory
+{
+
+/** Grid step of channel @a c. */
+inline double quantum(size_t c)
+{
+    return 0 == c ? g_trajectoryAngleStep : g_trajectoryPositionStep;
+}
+
+inline void put_varint(std::vector<uint8_t>& out, uint64_t v)
+{
+    while ( v >= 0x80 )
+    {
+        out.push_back(uint8_t(v) | 0x80);
+        v >>= 7;
+    }
+    out.push_back(uint8_t(v));
+}
+
+/** Read a varint from [at, end), returns false if it runs past the end. */
+inline bool get_varint(const uint8_t*& at, const uint8_t* end, uint64_t& v)
+{
+    v = 0;
+    for ( int shift = 0; at < end && shift < 64; shift += 7 )
+    {
+        uint8_t byte = *at++;
+        v |= uint64_t(byte & 0x7f) << shift;
+        if ( 0 == (byte & 0x80) ) return true;
+    }
+    return false;
+}
+
+inline uint64_t zigzag(int64_t v)
+{
+    return (uint64_t(v) << 1) ^ uint64_t(v >> 63);
+}
+
+inline int64_t unzigzag(uint64_t v)
+{
+    return int64_t(v >> 1) ^ -int64_t(v & 1);
+}
+
+}; // namespace trajectory
+
+/**
+ * Background trajectory writer
+ * The sim thread hands each step to record(), which copies the angles
+ * and positions into a ring of preallocated frames and returns; a writer
+ * thread takes frames from the ring, encodes them and writes chunks.
+ * record() never waits: when the writer falls a full ring behind
+ * (g_trajectoryRingBytes worth of frames), frames are dropped and counted
+ * instead.
+ */
+struct TrajectoryRecorder
+{
+    TrajectoryRecorder()
+        : file(NULL)
+        , n_bodies(0)
+        , head(0)
+        , tail(0)
+        , stopping(false)
+        , dropped(0)
+        , written(0)
+    {
+    }
+
+    ~TrajectoryRecorder()
+    {
+        close();
+    }
+
+    /** Start writing the trajectories of @a bodies bodies to @a path. */
+    inline bool open(const char* path, size_t bodies)
+    {
+        close();
+
+        file = fopen(path, "wb");
+        if ( NULL == file ) return false;
+
+        n_bodies = bodies;
+        head.store(0);
+        tail.store(0);
+        stopping.store(false);
+        dropped.store(0);
+        written = 0;
+
+        size_t frames = g_trajectoryRingBytes / (g_trajectoryChannels * sizeof(float) * (n_bodies ? n_bodies : 1));
+        frames = frames < g_trajectoryRingMinFrames ? g_trajectoryRingMinFrames : frames;
+        frames = frames > g_trajectoryRingMaxFrames ? g_trajectoryRingMaxFrames : frames;
+
+        ring.resize(frames);
+        for ( size_t i = 0; i < frames; i++ )
+        {
+            ring[i].step = 0;
+            ring[i].values.assign(g_trajectoryChannels * n_bodies, 0.0f);
+        }
+
+        TrajectoryHeader header;
+        memset(&header, 0, sizeof(header));
+        header.magic        = g_trajectoryMagic;
+        header.version      = g_trajectoryVersion;
+        header.bodies       = n_bodies;
+        header.channels     = g_trajectoryChannels;
+        header.chunkFrames  = g_trajectoryChunkFrames;
+        header.angleStep    = g_trajectoryAngleStep;
+        header.positionStep = g_trajectoryPositionStep;
+
+        fwrite(&header, sizeof(header), 1, file);
+        written = sizeof(header);
+
+        writer = std::thread(&TrajectoryRecorder::run, this);
+        return true;
+    }
+
+    /**
+     * Queue step @a step of @a bodies, sim thread only
+     * Returns false if the frame was dropped because the writer is behind.
+     */
+    inline bool record(const BodyStore& bodies, uint64_t step)
+    {
+        size_t h = head.load(std::memory_order_relaxed);
+        if ( h - tail.load(std::memory_order_acquire) >= ring.size() )
+        {
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+
+        Frame& frame = ring[h % ring.size()];
+        size_t n = n_bodies < bodies.count ? n_bodies : bodies.count;
+        float * values = frame.values.data();
+
+        frame.step = step;
+        memcpy(values,                bodies.angle,      n * sizeof(float));
+        memcpy(values + n_bodies,     bodies.position.x, n * sizeof(float));
+        memcpy(values + 2 * n_bodies, bodies.position.y, n * sizeof(float));
+        memcpy(values + 3 * n_bodies, bodies.position.z, n * sizeof(float));
+
+        head.store(h + 1, std::memory_order_release);
+        wake.notify_one();
+        return true;
+    }
+
+    /** Write what is queued, the index and the footer, and close the file. */
+    inline void close()
+    {
+        if ( NULL == file ) return;
+
+        stopping.store(true);
+        wake.notify_one();
+        writer.join();
+
+        fclose(file);
+        file = NULL;
+        std::vector<Frame>().swap(ring);
+    }
+
+    /** Frames dropped because the writer was behind. */
+    inline uint64_t dropped_frames() const
+    {
+        return dropped.load(std::memory_order_relaxed);
+    }
+
+    /** Bytes written so far, final once closed. */
+    inline uint64_t bytes_written() const
+    {
+        return written;
+    }
+
+private:
+    struct Frame
+    {
+        uint64_t           step;
+        std::vector<float> values;
+    };
+
+    /** Writer thread: encode frames as they arrive, until close(). */
+    inline void run()
+    {
+        std::vector<int64_t> last(g_trajectoryChannels * n_bodies, 0);
+        std::vector<int64_t> current(g_trajectoryChannels * n_bodies, 0);
+        std::vector<uint8_t> chunk;
+        std::vector<TrajectoryChunk> index;
+
+        TrajectoryChunk entry;
+        memset(&entry, 0, sizeof(entry));
+        uint64_t last_step = 0;
+
+        for ( ;; )
+        {
+            size_t t = tail.load(std::memory_order_relaxed);
+            if ( t == head.load(std::memory_order_acquire) )
+            {
+                if ( stopping.load() && t == head.load(std::memory_order_acquire) ) break;
+
+                /* record() notifies without the lock, so a wakeup can be
+                   missed; the timeout bounds how long that stalls */
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait_for(lock, std::chrono::milliseconds(1), [&]
+                {
+                    return stopping.load() || t != head.load(std::memory_order_acquire);
+                });
+                continue;
+            }
+
+            const Frame& frame = ring[t % ring.size()];
+
+            if ( 0 == entry.frames )
+            {
+                /* chunks start from zero so each decodes on its own */
+                entry.firstStep = frame.step;
+                std::fill(last.begin(), last.end(), 0);
+                last_step = 0;
+                chunk.clear();
+            }
+
+            trajectory::put_varint(chunk, frame.step - last_step);
+            last_step = frame.step;
+
+            for ( size_t c = 0; c < g_trajectoryChannels; c++ )
+            {
+                double scale = 1.0 / trajectory::quantum(c);
+                const float * values = frame.values.data() + c * n_bodies;
+                int64_t * q = current.data() + c * n_bodies;
+                const int64_t * previous = last.data() + c * n_bodies;
+
+                for ( size_t i = 0; i < n_bodies; i++ )
+                {
+                    q[i] = llrint(values[i] * scale);
+                    trajectory::put_varint(chunk, trajectory::zigzag(q[i] - previous[i]));
+                }
+            }
+
+            /* the frame is encoded, its slot can be refilled */
+            tail.store(t + 1, std::memory_order_release);
+            last.swap(current);
+
+            if ( ++entry.frames == g_trajectoryChunkFrames )
+            {
+                flush(chunk, entry, index);
+            }
+        }
+
+        if ( entry.frames > 0 ) flush(chunk, entry, index);
+
+        TrajectoryFooter footer;
+        memset(&footer, 0, sizeof(footer));
+        footer.indexOffset = written;
+        footer.chunks      = index.size();
+        footer.magic       = g_trajectoryMagic;
+
+        if ( !index.empty() ) fwrite(index.data(), sizeof(TrajectoryChunk), index.size(), file);
+        fwrite(&footer, sizeof(footer), 1, file);
+        written += index.size() * sizeof(TrajectoryChunk) + sizeof(footer);
+    }
+
+    inline void flush(std::vector<uint8_t>& chunk, TrajectoryChunk& entry, std::vector<TrajectoryChunk>& index)
+    {
+        entry.offset = written;
+        entry.bytes  = (uint32_t)chunk.size();
+
+        fwrite(chunk.data(), 1, chunk.size(), file);
+        written += chunk.size();
+
+        index.push_back(entry);
+        entry.frames = 0;
+    }
+
+    FILE * file;
+    size_t n_bodies;
+
+    /** frames [tail, head) are queued; the sim thread owns head, the writer tail */
+    std::vector<Frame>  ring;
+    std::atomic<size_t> head;
+    std::atomic<size_t> tail;
+
+    std::thread             writer;
+    std::mutex              mutex;
+    std::condition_variable wake;
+    std::atomic<bool>       stopping;
+
+    std::atomic<uint64_t> dropped;
+    /** file offset of the writer, read by others once it is closed */
+    uint64_t written;
+};
+
+/**
+ * Reads trajectory files written by TrajectoryRecorder
+ * Frames come back dequantized, channel after channel like BodyStore
+ * arrays: angles, then positions x, y and z of every body.
+ */
+struct TrajectoryReader
+{
+    TrajectoryHeader header;
+    std::vector<TrajectoryChunk> index;
+
+    TrajectoryReader()
+        : file(NULL)
+        , chunk_index(~size_t(0))
+        , cursor(NULL)
+        , frame_in_chunk(0)
+        , frame_step(0)
+    {
+        memset(&header, 0, sizeof(header));
+    }
+
+    ~TrajectoryReader()
+    {
+        if ( NULL != file ) fclose(file);
+    }
+
+    /** Open @a path and read its index, returns false if it is not a complete trajectory file. */
+    inline bool open(const char* path)
+    {
+        file = fopen(path, "rb");
+        if ( NULL == file ) return false;
+
+        TrajectoryFooter footer;
+        bool ok = 1 == fread(&header, sizeof(header), 1, file)
+               && g_trajectoryMagic == header.magic
+               && g_trajectoryVersion == header.version
+               && g_trajectoryChannels == header.channels
+               && 0 == fseek(file, -(long)sizeof(footer), SEEK_END)
+               && 1 == fread(&footer, sizeof(footer), 1, file)
+               && g_trajectoryMagic == footer.magic;
+
+        if ( ok )
+        {
+            index.resize(footer.chunks);
+            ok = 0 == fseek(file, (long)footer.indexOffset, SEEK_SET)
+              && (index.empty() || index.size() == fread(index.data(), sizeof(TrajectoryChunk), index.size(), file));
+        }
+
+        return ok;
+    }
+
+    /**
+     * Frame of step @a step, or the last one recorded before it
+     * @param values  channels * bodies floats
+     * @param found   step of the frame returned
+     * Returns false if no frame was recorded at or before @a step.
+     */
+    inline bool read(uint64_t step, float* values, uint64_t& found)
+    {
+        size_t c = index.size();
+        while ( c > 0 && index[c - 1].firstStep > step ) c--;
+        if ( 0 == c ) return false;
+        c--;
+
+        /* frames only decode forward from the start of their chunk */
+        if ( c != chunk_index || frame_step > step )
+        {
+            if ( !load_chunk(c) ) return false;
+        }
+
+        bool ok = true;
+        while ( ok && frame_in_chunk < index[c].frames )
+        {
+            const uint8_t * next = cursor;
+            uint64_t delta;
+            if ( !trajectory::get_varint(next, chunk.data() + chunk.size(), delta) ) return false;
+            if ( frame_in_chunk > 0 && frame_step + delta > step ) break;
+
+            ok = decode_frame();
+        }
+
+        if ( !ok || 0 == frame_in_chunk ) return false;
+
+        for ( size_t ch = 0; ch < header.channels; ch++ )
+        {
+            double q = trajectory::quantum(ch);
+            for ( size_t i = 0; i < header.bodies; i++ )
+            {
+                size_t k = ch * header.bodies + i;
+                values[k] = float(quantized[k] * q);
+            }
+        }
+
+        found = frame_step;
+        return true;
+    }
+
+private:
+    inline bool load_chunk(size_t c)
+    {
+        chunk.resize(index[c].bytes);
+        if ( 0 != fseek(file, (long)index[c].offset, SEEK_SET)
+          || (!chunk.empty() && 1 != fread(chunk.data(), chunk.size(), 1, file)) )
+        {
+            chunk_index = ~size_t(0);
+            return false;
+        }
+
+        chunk_index = c;
+        frame_in_chunk = 0;
+        frame_step = 0;
+        cursor = chunk.data();
+        quantized.assign(header.channels * header.bodies, 0);
+        return true;
+    }
+
+    inline bool decode_frame()
+    {
+        const uint8_t * end = chunk.data() + chunk.size();
+
+        uint64_t delta;
+        if ( !trajectory::get_varint(cursor, end, delta) ) return false;
+        frame_step += delta;
+
+        for ( size_t k = 0; k < quantized.size(); k++ )
+        {
+            if ( !trajectory::get_varint(cursor, end, delta) ) return false;
+            quantized[k] += trajectory::unzigzag(delta);
+        }
+
+        frame_in_chunk++;
+        return true;
+    }
+
+    FILE * file;
+
+    std::vector<uint8_t> chunk;
+    size_t               chunk_index;
+    const uint8_t *      cursor;
+    uint32_t             frame_in_chunk;
+    uint64_t             frame_step;
+    std::vector<int64_t> quantized;
+};
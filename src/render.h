@@ -196,3 +196,151 @@ struct LightProbe
     bgfx::TextureHandle m_tex;
     bgfx::TextureHandle m_texIrr;
 };
+
+namespace bgfx
+{
+    /** from bgfx's vertexdecl.cpp, as bgfx_utils uses it to read meshes */
+    int32_t read(bx::ReaderI* _reader, bgfx::VertexDecl& _decl);
+}
+
+/** bytes of instance data per body, its world matrix */
+static const uint16_t g_instanceStride = sizeof(float) * 16;
+/** bodies per instanced submit, so no one transient buffer gets too big */
+static const uint32_t g_instancesPerDraw = 16384;
+
+/**
+ * A geometryc mesh drawn once for many world matrices
+ * Loads the same .bin as meshLoad(), but keeps each group's buffers so an
+ * instance data buffer can go with every group's submit; meshSubmit()
+ * submits all groups under one draw state, which only the first would get.
+ * The instanced program reads the matrix of each instance from i_data0..3.
+ */
+struct InstancedMesh
+{
+    struct Group
+    {
+        bgfx::VertexBufferHandle m_vbh;
+        bgfx::IndexBufferHandle  m_ibh;
+    };
+
+    bool load(const char* _filePath)
+    {
+        bx::FileReaderI* reader = entry::getFileReader();
+        if ( 0 != bx::open(reader, _filePath) )
+        {
+            return false;
+        }
+
+        Group group;
+        group.m_vbh.idx = bgfx::invalidHandle;
+        group.m_ibh.idx = bgfx::invalidHandle;
+
+        uint32_t chunk;
+        while ( 4 == bx::read(reader, chunk) )
+        {
+            switch ( chunk )
+            {
+                case BX_MAKEFOURCC('V', 'B', ' ', 0x1):
+                {
+                    /* bounding sphere, aabb and obb, not needed to draw */
+                    float bounds[4 + 6 + 16];
+                    bx::read(reader, bounds, sizeof(bounds) );
+
+                    bgfx::VertexDecl decl;
+                    bgfx::read(reader, decl);
+
+                    uint16_t numVertices;
+                    bx::read(reader, numVertices);
+                    const bgfx::Memory* mem = bgfx::alloc(numVertices * decl.getStride() );
+                    bx::read(reader, mem->data, mem->size);
+                    group.m_vbh = bgfx::createVertexBuffer(mem, decl);
+                    break;
+                }
+
+                case BX_MAKEFOURCC('I', 'B', ' ', 0x0):
+                {
+                    uint32_t numIndices;
+                    bx::read(reader, numIndices);
+                    const bgfx::Memory* mem = bgfx::alloc(numIndices * 2);
+                    bx::read(reader, mem->data, mem->size);
+                    group.m_ibh = bgfx::createIndexBuffer(mem);
+                    break;
+                }
+
+                case BX_MAKEFOURCC('P', 'R', 'I', 0x0):
+                {
+                    /* material and primitive names and ranges, skipped */
+                    uint16_t len;
+                    bx::read(reader, len);
+                    bx::seek(reader, len);
+
+                    uint16_t num;
+                    bx::read(reader, num);
+                    for ( uint32_t ii = 0; ii < num; ii++ )
+                    {
+                        bx::read(reader, len);
+                        bx::seek(reader, len + 4 * sizeof(uint32_t) + sizeof(float) * (4 + 6 + 16) );
+                    }
+
+                    m_groups.push_back(group);
+                    group.m_vbh.idx = bgfx::invalidHandle;
+                    group.m_ibh.idx = bgfx::invalidHandle;
+                    break;
+                }
+
+                default:
+                    break;
+            }
+        }
+
+        bx::close(reader);
+        return !m_groups.empty();
+    }
+
+    void unload()
+    {
+        for ( size_t i = 0; i < m_groups.size(); i++ )
+        {
+            bgfx::destroyVertexBuffer(m_groups[i].m_vbh);
+            bgfx::destroyIndexBuffer(m_groups[i].m_ibh);
+        }
+        m_groups.clear();
+    }
+
+    /**
+     * Draw the mesh once for each of @a _num matrices of @a _worlds, one
+     * submit a group for every g_instancesPerDraw of them
+     * Returns how many were drawn; the rest did not fit this frame's
+     * transient buffers.
+     */
+    uint32_t submit(uint8_t _id, bgfx::ProgramHandle _program, const Matrix4* _worlds, uint32_t _num, uint64_t _state = BGFX_STATE_DEFAULT) const
+    {
+        uint32_t drawn = 0;
+        while ( drawn < _num )
+        {
+            uint32_t count = _num - drawn < g_instancesPerDraw ? _num - drawn : g_instancesPerDraw;
+            if ( !bgfx::checkAvailInstanceDataBuffer(count, g_instanceStride) )
+            {
+                break;
+            }
+
+            const bgfx::InstanceDataBuffer* idb = bgfx::allocInstanceDataBuffer(count, g_instanceStride);
+            memcpy(idb->data, &_worlds[drawn], count * g_instanceStride);
+
+            for ( size_t i = 0; i < m_groups.size(); i++ )
+            {
+                bgfx::setVertexBuffer(m_groups[i].m_vbh);
+                bgfx::setIndexBuffer(m_groups[i].m_ibh);
+                bgfx::setInstanceDataBuffer(idb);
+                bgfx::setState(_state);
+                bgfx::submit(_id, _program);
+            }
+
+            drawn += count;
+        }
+
+        return drawn;
+    }
+
+    std::vector<Group> m_groups;
+};
@@ -0,0 +1,565 @@
+/**
+ * Benchmarks of the physics and math hot paths
+ * Every benchmark runs at each body count of a sweep, repeating until it
+ * has run for --min-time. Results print as a table and, with --json, in
+ * the JSON layout of Google Benchmark, so its tools read them as well.
+ * scripts/compare_bench.py compares two runs and flags regressions.
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "core/job_system.h"
+
+#include "math/math_types.h"
+#include "math/matrix4.h"
+#include "math/vector3.h"
+
+#include "physics/body_store.h"
+#include "physics/entity.h"
+#include "physics/kernels.h"
+#include "physics/resolver.h"
+#include "physics/simulation.h"
+
+/** body counts swept by default, from one cradle up */
+static const size_t c_defaultSizes[] = { 5, 100, 10000, 1000000, 10000000 };
+/** runs past this many iterations are long enough, however fast */
+static const size_t c_maxIterations = size_t(1) << 30;
+
+struct BenchOptions
+{
+    std::vector<size_t> sizes;
+    size_t      max_bodies;
+    double      min_time;
+    size_t      n_threads;
+    const char* filter;
+    const char* json_path;
+};
+
+/** Everything a benchmark works on; setup fills what it needs and frees the rest. */
+struct BenchState
+{
+    size_t n;
+
+    std::vector<PhysicsBody> entities;
+    std::vector<Matrix4>     matrices;
+
+    std::unique_ptr<Simulation> simulation;
+    std::vector<CollisionPair>  pairs;
+    std::vector<uint8_t>        hit;
+
+    JobSystem * jobs;
+
+    inline void clear()
+    {
+        std::vector<PhysicsBody>().swap(entities);
+        std::vector<Matrix4>().swap(matrices);
+        simulation.reset();
+        std::vector<CollisionPair>().swap(pairs);
+        std::vector<uint8_t>().swap(hit);
+    }
+};
+
+typedef void  (*BenchSetup)(BenchState& state);
+/** One iteration over all n bodies; returns a value that depends on the work, so it is not optimized away. */
+typedef float (*BenchRun)(BenchState& state);
+
+struct Benchmark
+{
+    const char * name;
+    BenchSetup   setup;
+    BenchRun     run;
+};
+
+/** sink for benchmark results */
+static volatile float s_sink = 0.0f;
+
+/* setups */
+
+/** A row of PhysicsBody pendulums one unit apart, each lifted a little. */
+static void setup_entities(BenchState& state)
+{
+    state.entities.resize(state.n);
+    for ( size_t i = 0; i < state.n; i++ )
+    {
+        Vector3 pos = vector3::vector3(1.0f * i, 0.0f, 0.0f);
+        state.entities[i].init_body(pos, 10.0f, 0.0f, 0.5f, 2.25f);
+        state.entities[i].angle = state.entities[i].lastAngle = 10.0f;
+        state.entities[i].position.y -= 2.25f;
+    }
+}
+
+static void setup_matrices(BenchState& state)
+{
+    state.matrices.assign(state.n, Matrix4::identity());
+    for ( size_t i = 0; i < state.n; i++ )
+    {
+        state.matrices[i].d.x = 1.0f * i;
+    }
+}
+
+/**
+ * A Simulation of n bodies, the first raised, that never sleeps
+ * @a radius over 0.5 leaves neighbors overlapping while they hang.
+ */
+static void setup_simulation(BenchState& state, float radius)
+{
+    state.simulation.reset(new Simulation());
+
+    Simulation& simulation = *state.simulation;
+    simulation.jobs = state.jobs;
+    simulation.allowSleeping = false;
+    simulation.create_bodies(state.n, 10.0f, radius);
+    simulation.set_starting_angles(30.0f, 1, 0);
+}
+
+static void setup_stepping(BenchState& state)
+{
+    setup_simulation(state, 0.5f);
+}
+
+/** A stepping Simulation and a matrix for each of its bodies. */
+static void setup_render(BenchState& state)
+{
+    setup_simulation(state, 0.5f);
+    state.matrices.resize(state.n);
+}
+
+/** Every neighbor pair of an overlapping row, with its contact found. */
+static void setup_contacts(BenchState& state)
+{
+    setup_simulation(state, 0.55f);
+
+    size_t n_pairs = state.n > 0 ? state.n - 1 : 0;
+    state.pairs.resize(n_pairs);
+    state.hit.resize(n_pairs);
+    for ( size_t i = 0; i < n_pairs; i++ )
+    {
+        state.pairs[i] = CollisionPair();
+        state.pairs[i].bodyA = (uint32_t)i;
+        state.pairs[i].bodyB = (uint32_t)(i + 1);
+    }
+
+    kernels::active().narrowphase(state.simulation->bodies, state.pairs.data(), 0, n_pairs, state.hit.data());
+}
+
+/* runs */
+
+static float run_entity_update(BenchState& state)
+{
+    for ( size_t i = 0; i < state.n; i++ )
+    {
+        state.entities[i].applyGravity();
+        state.entities[i].update(g_fixedDeltaTime, 1.0f);
+        state.entities[i].clearForces();
+    }
+    return state.entities[state.n - 1].angle;
+}
+
+static float run_entity_solve_constraint(BenchState& state)
+{
+    for ( size_t i = 0; i < state.n; i++ )
+    {
+        state.entities[i].solve_constraint();
+    }
+    return state.entities[state.n - 1].position.x;
+}
+
+/** Each sphere against its right neighbor, as the per-frame collision loop of the app did. */
+static float run_entity_check_collision(BenchState& state)
+{
+    size_t hits = 0;
+    for ( size_t i = 0; i + 1 < state.n; i++ )
+    {
+        hits += state.entities[i].collision.check_collision(state.entities[i + 1].collision) ? 1 : 0;
+    }
+    return float(hits);
+}
+
+static float run_matrix4_multiply(BenchState& state)
+{
+    Matrix4 step = Matrix4::identity();
+    step.d.x = 1.0f;
+
+    for ( size_t i = 0; i < state.n; i++ )
+    {
+        state.matrices[i] *= step;
+    }
+    return state.matrices[state.n - 1].d.x;
+}
+
+static float run_kernel_update(BenchState& state)
+{
+    BodyStore& bodies = state.simulation->bodies;
+    kernels::active().update(bodies, 0, bodies.count, g_fixedDeltaTime, 1.0f);
+    return bodies.angle[bodies.count - 1];
+}
+
+static float run_kernel_solve_constraint(BenchState& state)
+{
+    BodyStore& bodies = state.simulation->bodies;
+    kernels::active().solve_constraint(bodies, 0, bodies.count);
+    return bodies.position.x[bodies.count - 1];
+}
+
+static float run_kernel_narrowphase(BenchState& state)
+{
+    kernels::active().narrowphase(state.simulation->bodies, state.pairs.data(), 0, state.pairs.size(), state.hit.data());
+    return state.pairs.empty() ? 0.0f : state.pairs.back().collision.penetration;
+}
+
+/** Each body moved along the row and rotated by its own matrices, as the app's render loop did. */
+static float run_render_per_body(BenchState& state)
+{
+    const Simulation& simulation = *state.simulation;
+
+    Matrix4 row = Matrix4::identity();
+    row.d.x = -(state.n / 2.0f);
+    Matrix4 move = Matrix4::identity();
+    move.d.x = 1.0f;
+
+    for ( size_t i = 0; i < state.n; i++ )
+    {
+        row *= move;
+
+        float rad = simulation.interpolated_angle(i, 0.5f) * float(M_PI / 180);
+        Matrix4 rot = Matrix4::identity();
+        rot.a.x = cosf(rad); rot.a.y = -sinf(rad);
+        rot.b.x = sinf(rad); rot.b.y =  cosf(rad);
+
+        state.matrices[i] = row;
+        state.matrices[i] *= rot;
+    }
+    return state.matrices[state.n - 1].a.y;
+}
+
+static float run_render_transforms(BenchState& state)
+{
+    Vector3 offset = vector3::vector3(1.0f - state.n / 2.0f, 0.0f, 0.0f);
+    state.simulation->transforms(0.5f, offset, state.matrices.data());
+    return state.matrices[state.n - 1].a.y;
+}
+
+/** Position pass of the resolver: presolve, one iteration, postsolve. */
+static float run_resolver_position(BenchState& state)
+{
+    BodyStore& bodies = state.simulation->bodies;
+
+    for ( size_t i = 0; i < state.pairs.size(); i++ )
+    {
+        presolve_position(bodies, state.pairs[i]);
+    }
+    for ( size_t i = 0; i < state.pairs.size(); i++ )
+    {
+        solve_position(bodies, state.pairs[i]);
+    }
+    postsolve_positions(bodies, 0, bodies.count);
+
+    return bodies.angle[bodies.count - 1];
+}
+
+/** Velocity pass of the resolver: presolve and one iteration, warm started. */
+static float run_resolver_velocity(BenchState& state)
+{
+    BodyStore& bodies = state.simulation->bodies;
+    float restingSpeed = resting_speed(g_fixedDeltaTime);
+
+    for ( size_t i = 0; i < state.pairs.size(); i++ )
+    {
+        presolve_velocity(bodies, state.pairs[i], restingSpeed, true);
+    }
+    for ( size_t i = 0; i < state.pairs.size(); i++ )
+    {
+        solve_velocity(bodies, state.pairs[i], restingSpeed);
+    }
+
+    return bodies.lastAngle[bodies.count - 1];
+}
+
+/** Broadphase and contact resolution, the collision half of a step. */
+static float run_simulation_collide(BenchState& state)
+{
+    Simulation& simulation = *state.simulation;
+    simulation.frame.reset();
+    simulation.find_pairs();
+    simulation.resolve_contacts(g_fixedDeltaTime);
+    return simulation.bodies.angle[0];
+}
+
+static float run_simulation_step(BenchState& state)
+{
+    Simulation& simulation = *state.simulation;
+    simulation.step(g_fixedDeltaTime, 1.0f);
+    return simulation.bodies.angle[0];
+}
+
+static const Benchmark c_benchmarks[] =
+{
+    { "entity/update",            setup_entities,  run_entity_update },
+    { "entity/solve_constraint",  setup_entities,  run_entity_solve_constraint },
+    { "entity/check_collision",   setup_entities,  run_entity_check_collision },
+    { "matrix4/multiply",         setup_matrices,  run_matrix4_multiply },
+    { "kernels/update",           setup_stepping,  run_kernel_update },
+    { "kernels/solve_constraint", setup_stepping,  run_kernel_solve_constraint },
+    { "kernels/narrowphase",      setup_contacts,  run_kernel_narrowphase },
+    { "render/per_body",          setup_render,    run_render_per_body },
+    { "render/transforms",        setup_render,    run_render_transforms },
+    { "resolver/position",        setup_contacts,  run_resolver_position },
+    { "resolver/velocity",        setup_contacts,  run_resolver_velocity },
+    { "simulation/collide",       setup_stepping,  run_simulation_collide },
+    { "simulation/step",          setup_stepping,  run_simulation_step },
+};
+
+struct BenchResult
+{
+    std::string name;
+    size_t      iterations;
+    /** per iteration, in nanoseconds */
+    double      real_time;
+    double      cpu_time;
+    double      items_per_second;
+};
+
+/**
+ * Time @a bench over state.n bodies
+ * Doubles the iterations, or jumps straight to about enough of them,
+ * until a batch runs for @a min_time seconds; that batch is reported.
+ */
+static BenchResult measure(const Benchmark& bench, BenchState& state, double min_time)
+{
+    typedef std::chrono::steady_clock Clock;
+
+    BenchResult result;
+    result.name = std::string(bench.name) + "/" + std::to_string(state.n);
+
+    size_t iterations = 1;
+    for ( ;; )
+    {
+        std::clock_t cpu_start = std::clock();
+        Clock::time_point start = Clock::now();
+
+        float sink = 0.0f;
+        for ( size_t i = 0; i < iterations; i++ )
+        {
+            sink += bench.run(state);
+        }
+        s_sink = s_sink + sink;
+
+        double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        double cpu_seconds = double(std::clock() - cpu_start) / CLOCKS_PER_SEC;
+
+        if ( seconds >= min_time || iterations >= c_maxIterations )
+        {
+            result.iterations = iterations;
+            result.real_time  = seconds * 1e9 / iterations;
+            result.cpu_time   = cpu_seconds * 1e9 / iterations;
+            result.items_per_second = seconds > 0 ? double(state.n) * iterations / seconds : 0.0;
+            return result;
+        }
+
+        /* aim 40% past min_time, but never grow more than tenfold at once */
+        double wanted = seconds > 0 ? 1.4 * min_time / seconds * iterations : 10.0 * iterations;
+        size_t next = wanted > 10.0 * iterations ? 10 * iterations : size_t(wanted);
+        iterations = next > 2 * iterations ? next : 2 * iterations;
+        if ( iterations > c_maxIterations ) iterations = c_maxIterations;
+    }
+}
+
+static void print_usage()
+{
+    printf( "usage: cradle_bench [options]\n"
+            "  --sizes <n,...>   body counts to sweep (default 5,100,10000,1000000,10000000)\n"
+            "  --max-bodies <n>  skip body counts above n (default: no limit)\n"
+            "  --min-time <s>    run each benchmark at least this long (default 0.5)\n"
+            "  --threads <n>     worker threads for the simulation benchmarks, 0 for one per core (default 1)\n"
+            "  --filter <text>   only run benchmarks whose name contains text\n"
+            "  --json <file>     also write the results as JSON\n"
+            "  --list            print the benchmark names and exit\n"
+        );
+}
+
+static bool parse_sizes(const char* text, std::vector<size_t>& sizes)
+{
+    sizes.clear();
+    while ( '\0' != *text )
+    {
+        char* end;
+        unsigned long long n = strtoull(text, &end, 10);
+        if ( end == text || 0 == n ) return false;
+
+        sizes.push_back((size_t)n);
+        text = ',' == *end ? end + 1 : end;
+        if ( '\0' != *end && ',' != *end ) return false;
+    }
+    return !sizes.empty();
+}
+
+static bool parse_options(int argc, char** argv, BenchOptions& options, bool& list)
+{
+    for ( int i = 1; i < argc; i++ )
+    {
+        const char* arg = argv[i];
+        const char* value = (i + 1 < argc) ? argv[i + 1] : NULL;
+
+        if ( 0 == strcmp(arg, "--help") || 0 == strcmp(arg, "-h") )
+        {
+            return false;
+        }
+
+        if ( 0 == strcmp(arg, "--list") )
+        {
+            list = true;
+            continue;
+        }
+
+        if ( NULL == value )
+        {
+            fprintf(stderr, "cradle_bench: missing value for %s\n", arg);
+            return false;
+        }
+
+        if      ( 0 == strcmp(arg, "--max-bodies") ) options.max_bodies = strtoull(value, NULL, 10);
+        else if ( 0 == strcmp(arg, "--min-time") )   options.min_time   = atof(value);
+        else if ( 0 == strcmp(arg, "--threads") )    options.n_threads  = strtoul(value, NULL, 10);
+        else if ( 0 == strcmp(arg, "--filter") )     options.filter     = value;
+        else if ( 0 == strcmp(arg, "--json") )       options.json_path  = value;
+        else if ( 0 == strcmp(arg, "--sizes") )
+        {
+            if ( !parse_sizes(value, options.sizes) )
+            {
+                fprintf(stderr, "cradle_bench: bad body counts '%s'\n", value);
+                return false;
+            }
+        }
+        else
+        {
+            fprintf(stderr, "cradle_bench: unknown option %s\n", arg);
+            return false;
+        }
+        i++;
+    }
+
+    return true;
+}
+
+/** Write @a results as Google Benchmark JSON to @a path. */
+static bool write_json(const char* path, const std::vector<BenchResult>& results, const JobSystem& jobs)
+{
+    FILE* file = fopen(path, "w");
+    if ( NULL == file ) return false;
+
+    char date[64];
+    time_t now = time(NULL);
+    strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", localtime(&now));
+
+    fprintf(file, "{\n");
+    fprintf(file, "  \"context\": {\n");
+    fprintf(file, "    \"date\": \"%s\",\n", date);
+    fprintf(file, "    \"executable\": \"cradle_bench\",\n");
+    fprintf(file, "    \"num_cpus\": %u,\n", std::thread::hardware_concurrency());
+    fprintf(file, "    \"kernels\": \"%s\",\n", kernels::active().name);
+    fprintf(file, "    \"threads\": %zu,\n", jobs.thread_count());
+#if defined(NDEBUG)
+    fprintf(file, "    \"library_build_type\": \"release\"\n");
+#else
+    fprintf(file, "    \"library_build_type\": \"debug\"\n");
+#endif
+    fprintf(file, "  },\n");
+    fprintf(file, "  \"benchmarks\": [\n");
+
+    for ( size_t i = 0; i < results.size(); i++ )
+    {
+        const BenchResult& r = results[i];
+        fprintf(file, "    {\n");
+        fprintf(file, "      \"name\": \"%s\",\n", r.name.c_str());
+        fprintf(file, "      \"run_name\": \"%s\",\n", r.name.c_str());
+        fprintf(file, "      \"run_type\": \"iteration\",\n");
+        fprintf(file, "      \"iterations\": %zu,\n", r.iterations);
+        fprintf(file, "      \"real_time\": %.6e,\n", r.real_time);
+        fprintf(file, "      \"cpu_time\": %.6e,\n", r.cpu_time);
+        fprintf(file, "      \"time_unit\": \"ns\",\n");
+        fprintf(file, "      \"items_per_second\": %.6e\n", r.items_per_second);
+        fprintf(file, "    }%s\n", i + 1 < results.size() ? "," : "");
+    }
+
+    fprintf(file, "  ]\n");
+    fprintf(file, "}\n");
+
+    return 0 == fclose(file);
+}
+
+int main(int argc, char** argv)
+{
+    BenchOptions options;
+    options.sizes.assign(c_defaultSizes, c_defaultSizes + sizeof(c_defaultSizes) / sizeof(c_defaultSizes[0]));
+    options.max_bodies = ~size_t(0);
+    options.min_time   = 0.5;
+    options.n_threads  = 1;
+    options.filter     = NULL;
+    options.json_path  = NULL;
+
+    bool list = false;
+    if ( !parse_options(argc, argv, options, list) )
+    {
+        print_usage();
+        return EXIT_FAILURE;
+    }
+
+    size_t n_benchmarks = sizeof(c_benchmarks) / sizeof(c_benchmarks[0]);
+    if ( list )
+    {
+        for ( size_t b = 0; b < n_benchmarks; b++ )
+        {
+            printf("%s\n", c_benchmarks[b].name);
+        }
+        return EXIT_SUCCESS;
+    }
+
+    JobSystem jobs;
+    jobs.init(options.n_threads, false);
+
+    BenchState state;
+    state.jobs = &jobs;
+
+    printf("kernels: %s, threads: %zu\n", kernels::active().name, jobs.thread_count());
+    printf("%-36s %14s %14s %12s %14s\n", "benchmark", "time/iter", "cpu/iter", "iterations", "bodies/s");
+
+    std::vector<BenchResult> results;
+    for ( size_t b = 0; b < n_benchmarks; b++ )
+    {
+        const Benchmark& bench = c_benchmarks[b];
+        if ( NULL != options.filter && NULL == strstr(bench.name, options.filter) ) continue;
+
+        for ( size_t s = 0; s < options.sizes.size(); s++ )
+        {
+            if ( options.sizes[s] > options.max_bodies ) continue;
+
+            state.clear();
+            state.n = options.sizes[s];
+            bench.setup(state);
+
+            BenchResult result = measure(bench, state, options.min_time);
+            printf("%-36s %11.1f ns %11.1f ns %12zu %14.4g\n", result.name.c_str(),
+                    result.real_time, result.cpu_time, result.iterations, result.items_per_second);
+            fflush(stdout);
+
+            results.push_back(result);
+        }
+    }
+    state.clear();
+
+    if ( NULL != options.json_path && !write_json(options.json_path, results, jobs) )
+    {
+        fprintf(stderr, "cradle_bench: cannot write '%s'\n", options.json_path);
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
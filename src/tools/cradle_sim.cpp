@@ -0,0 +1,941 @@
+/**
+ * Headless entrypoint for Newton's Cradle simulation
+ * Steps the physics as fast as possible without bgfx, imgui or vsync
+ */
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <vector>
+
+#include "core/job_system.h"
+
+#include "physics/clock.h"
+#include "physics/ensemble.h"
+#include "physics/kernels.h"
+#include "physics/simulation.h"
+#include "physics/trajectory.h"
+
+/** heap allocations made through operator new, on any thread */
+static std::atomic<size_t> s_allocations(0);
+
+void* operator new(size_t size)
+{
+    s_allocations.fetch_add(1, std::memory_order_relaxed);
+
+    void* memory = malloc(0 == size ? 1 : size);
+    if ( NULL == memory ) throw std::bad_alloc();
+    return memory;
+}
+
+/* GCC flags free() on memory from operator new, which is exactly the pairing here */
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 11
+#   pragma GCC diagnostic push
+#   pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+void operator delete(void* memory) noexcept
+{
+    free(memory);
+}
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 11
+#   pragma GCC diagnostic pop
+#endif
+
+/** steps allowed to grow buffers before --check-alloc starts counting */
+static const size_t c_warmupSteps = 100;
+
+struct SimOptions
+{
+    size_t n_balls;
+    size_t cradle_size;
+    size_t n_steps;
+    float  delta_time;
+    float  starting_degree;
+    size_t left_used;
+    size_t right_used;
+    size_t n_threads;
+    bool   deterministic;
+    ContactOrder::Enum contact_order;
+    BroadphaseType::Enum broadphase;
+    bool   verify_kernels;
+    bool   check_alloc;
+    bool   cold_start;
+    bool   contact_error;
+    bool   no_sleep;
+    bool   no_ccd;
+    bool   energy;
+    StepEngine::Enum engine;
+    SwingIntegrator::Enum integrator;
+    const char* record_path;
+    const char* replay_path;
+    const char* save_path;
+    const char* restore_path;
+    const char* trajectory_path;
+    const char* ensemble_path;
+    const char* summary_path;
+};
+
+static void print_usage()
+{
+    printf( "usage: cradle_sim [options]\n"
+            "  --balls <n>     number of pendulums (default 5)\n"
+            "  --cradle <n>    pendulums per cradle, 0 for a single row (default 0)\n"
+            "  --steps <n>     number of physics steps (default 100000)\n"
+            "  --dt <t>        step size in simulation time (default 1/12)\n"
+            "  --degrees <d>   starting angle of raised balls (default 30)\n"
+            "  --left <n>      balls raised on the left (default 1)\n"
+            "  --right <n>     balls raised on the right (default 0)\n"
+            "  --kernels <k>   scalar, sse2, avx2 or avx512 (default: widest supported)\n"
+            "  --threads <n>   worker threads including the main one, 0 for one per core (default 1)\n"
+            "  --contacts <o>  serial, colored or islands contact resolution order (default islands)\n"
+            "  --broadphase <b> grid or sap (default sap)\n"
+            "  --deterministic split work independently of the thread count\n"
+            "  --verify        check every supported kernel set against scalar, and that\n"
+            "                  late sweeps do not allocate, and exit\n"
+            "  --check-alloc   fail if a step allocates once the first 100 steps have run\n"
+            "  --cold          solve contacts without warm starting\n"
+            "  --contact-error report the mean and worst speed contacts still close at after solving\n"
+            "  --no-sleep      keep stepping bodies that have come to rest\n"
+            "  --no-ccd        let fast bodies pass through each other between steps\n"
+            "  --engine <e>    stepped or events (default stepped)\n"
+            "  --integrator <i> verlet, leapfrog, yoshida or exact swing integrator (default verlet)\n"
+            "  --energy        report how much the total energy drifted\n"
+            "  --record <file> log the run's inputs and final state hash for --replay\n"
+            "  --replay <file> re-simulate a logged run and check it against its hashes\n"
+            "  --save <file>   write a snapshot of the final state\n"
+            "  --restore <file> start from a snapshot instead of new bodies\n"
+            "  --trajectory <file> record every step's angles and positions, compressed\n"
+            "  --ensemble <file> run every cradle listed in the file side by side, one per line as\n"
+            "                  balls mass radius length degrees left right [copies]\n"
+            "  --summary <file> write per-cradle ensemble results as CSV (default: stdout)\n"
+        );
+}
+
+static bool parse_options(int argc, char** argv, SimOptions& options)
+{
+    for ( int i = 1; i < argc; i++ )
+    {
+        const char* arg = argv[i];
+        const char* value = (i + 1 < argc) ? argv[i + 1] : NULL;
+
+        if ( 0 == strcmp(arg, "--help") || 0 == strcmp(arg, "-h") )
+        {
+            return false;
+        }
+
+        if ( 0 == strcmp(arg, "--verify") )
+        {
+            options.verify_kernels = true;
+            continue;
+        }
+
+        if ( 0 == strcmp(arg, "--deterministic") )
+        {
+            options.deterministic = true;
+            continue;
+        }
+
+        if ( 0 == strcmp(arg, "--check-alloc") )
+        {
+            options.check_alloc = true;
+            continue;
+        }
+
+        if ( 0 == strcmp(arg, "--cold") )
+        {
+            options.cold_start = true;
+            continue;
+        }
+
+        if ( 0 == strcmp(arg, "--contact-error") )
+        {
+            options.contact_error = true;
+            continue;
+        }
+
+        if ( 0 == strcmp(arg, "--no-sleep") )
+        {
+            options.no_sleep = true;
+            continue;
+        }
+
+        if ( 0 == strcmp(arg, "--no-ccd") )
+        {
+            options.no_ccd = true;
+            continue;
+        }
+
+        if ( 0 == strcmp(arg, "--energy") )
+        {
+            options.energy = true;
+            continue;
+        }
+
+        if ( NULL == value )
+        {
+            fprintf(stderr, "cradle_sim: missing value for '%s'\n", arg);
+            return false;
+        }
+
+        if      ( 0 == strcmp(arg, "--balls") )   options.n_balls         = strtoul(value, NULL, 10);
+        else if ( 0 == strcmp(arg, "--cradle") )  options.cradle_size     = strtoul(value, NULL, 10);
+        else if ( 0 == strcmp(arg, "--steps") )   options.n_steps         = strtoul(value, NULL, 10);
+        else if ( 0 == strcmp(arg, "--dt") )      options.delta_time      = (float)atof(value);
+        else if ( 0 == strcmp(arg, "--degrees") ) options.starting_degree = (float)atof(value);
+        else if ( 0 == strcmp(arg, "--left") )    options.left_used       = strtoul(value, NULL, 10);
+        else if ( 0 == strcmp(arg, "--right") )   options.right_used      = strtoul(value, NULL, 10);
+        else if ( 0 == strcmp(arg, "--threads") ) options.n_threads       = strtoul(value, NULL, 10);
+        else if ( 0 == strcmp(arg, "--record") )  options.record_path     = value;
+        else if ( 0 == strcmp(arg, "--replay") )  options.replay_path     = value;
+        else if ( 0 == strcmp(arg, "--save") )    options.save_path       = value;
+        else if ( 0 == strcmp(arg, "--restore") ) options.restore_path    = value;
+        else if ( 0 == strcmp(arg, "--trajectory") ) options.trajectory_path = value;
+        else if ( 0 == strcmp(arg, "--ensemble") ) options.ensemble_path = value;
+        else if ( 0 == strcmp(arg, "--summary") )  options.summary_path  = value;
+        else if ( 0 == strcmp(arg, "--contacts") )
+        {
+            if      ( 0 == strcmp(value, "serial") )  options.contact_order = ContactOrder::Serial;
+            else if ( 0 == strcmp(value, "colored") ) options.contact_order = ContactOrder::Colored;
+            else if ( 0 == strcmp(value, "islands") ) options.contact_order = ContactOrder::Islands;
+            else
+            {
+                fprintf(stderr, "cradle_sim: unknown contact order '%s'\n", value);
+                return false;
+            }
+        }
+        else if ( 0 == strcmp(arg, "--engine") )
+        {
+            if      ( 0 == strcmp(value, "stepped") ) options.engine = StepEngine::Stepped;
+            else if ( 0 == strcmp(value, "events") )  options.engine = StepEngine::Events;
+            else
+            {
+                fprintf(stderr, "cradle_sim: unknown engine '%s'\n", value);
+                return false;
+            }
+        }
+        else if ( 0 == strcmp(arg, "--integrator") )
+        {
+            if      ( 0 == strcmp(value, "verlet") )   options.integrator = SwingIntegrator::Verlet;
+            else if ( 0 == strcmp(value, "leapfrog") ) options.integrator = SwingIntegrator::Leapfrog;
+            else if ( 0 == strcmp(value, "yoshida") )  options.integrator = SwingIntegrator::Yoshida;
+            else if ( 0 == strcmp(value, "exact") )    options.integrator = SwingIntegrator::Exact;
+            else
+            {
+                fprintf(stderr, "cradle_sim: unknown integrator '%s'\n", value);
+                return false;
+            }
+        }
+        else if ( 0 == strcmp(arg, "--broadphase") )
+        {
+            if      ( 0 == strcmp(value, "grid") ) options.broadphase = BroadphaseType::Grid;
+            else if ( 0 == strcmp(value, "sap") )  options.broadphase = BroadphaseType::SweepAndPrune;
+            else
+            {
+                fprintf(stderr, "cradle_sim: unknown broadphase '%s'\n", value);
+                return false;
+            }
+        }
+        else if ( 0 == strcmp(arg, "--kernels") )
+        {
+            KernelSet::Enum set = kernels::from_name(value);
+            if ( KernelSet::Count == set || !kernels::select(set) )
+            {
+                fprintf(stderr, "cradle_sim: kernel set '%s' is not available\n", value);
+                return false;
+            }
+        }
+        else
+        {
+            fprintf(stderr, "cradle_sim: unknown option '%s'\n", arg);
+            return false;
+        }
+
+        i++;
+    }
+
+    if ( options.n_balls < 2 || options.delta_time <= 0.0f )
+    {
+        fprintf(stderr, "cradle_sim: need at least 2 balls and a positive dt\n");
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * Total energy of the cradle, kinetic plus potential above the bottom
+ * Swing rates come from the last step, except under the event engine,
+ * which knows them exactly.
+ */
+static double cradle_energy(const Simulation& simulation, float deltaTime)
+{
+    if ( StepEngine::Events == simulation.engine && simulation.events.time > 0.0 )
+    {
+        return simulation.events.energy();
+    }
+
+    return body_store::energy(simulation.bodies, 0, simulation.bodies.count, deltaTime);
+}
+
+/** Largest difference between @a n floats, relative to max(1, |expected|). */
+static float max_difference(const float* expected, const float* actual, size_t n)
+{
+    float worst = 0.0f;
+    for ( size_t i = 0; i < n; i++ )
+    {
+        float scale = fabsf(expected[i]) > 1.0f ? fabsf(expected[i]) : 1.0f;
+        float diff = fabsf(expected[i] - actual[i]) / scale;
+        if ( diff > worst || diff != diff ) worst = diff;
+    }
+    return worst;
+}
+
+/**
+ * Run every supported kernel set against the scalar reference on a spread of
+ * body states. update and narrowphase must agree bit for bit, swing,
+ * solve_constraint and transforms within @a tolerance since the vector
+ * sin/cos are float polynomials.
+ */
+static bool verify_kernels(float tolerance)
+{
+    const size_t n_bodies = 1037;
+    bool ok = true;
+
+    Simulation reference;
+    reference.create_bodies(n_bodies);
+
+    uint32_t seed = 12345;
+    for ( size_t i = 0; i < n_bodies; i++ )
+    {
+        seed = seed * 1664525u + 1013904223u;
+        float r = (seed >> 8) / float(1 << 24);
+
+        reference.bodies.angle[i]      = (r - 0.5f) * 160.0f;
+        reference.bodies.lastAngle[i]  = reference.bodies.angle[i] - (r - 0.5f) * 3.0f;
+        reference.bodies.position.y[i] = -r * 2.0f;
+    }
+
+    for ( size_t warmup = 0; warmup < 4; warmup++ )
+    {
+        for ( int set = KernelSet::SSE2; set < KernelSet::Count; set++ )
+        {
+            if ( !kernels::supported(KernelSet::Enum(set)) ) continue;
+
+            const Kernels& simd = kernels::get(KernelSet::Enum(set));
+            const Kernels& scalar = kernels::get(KernelSet::Scalar);
+
+            BodyStore expected;
+            BodyStore actual;
+            expected.assign(reference.bodies);
+            actual.assign(reference.bodies);
+
+            /* odd range exercises the scalar tail of every width */
+            body_store::applyGravity(expected, 0, n_bodies);
+            body_store::applyGravity(actual, 0, n_bodies);
+            scalar.update(expected, 3, n_bodies, g_fixedDeltaTime, 1.0f);
+            simd.update(actual, 3, n_bodies, g_fixedDeltaTime, 1.0f);
+
+            const float* update_fields[][2] =
+            {
+                { expected.position.x, actual.position.x },
+                { expected.position.y, actual.position.y },
+                { expected.lastPosition.y, actual.lastPosition.y },
+                { expected.angle, actual.angle },
+                { expected.lastAngle, actual.lastAngle },
+                { expected.speed, actual.speed },
+                { expected.angularSpeed, actual.angularSpeed },
+            };
+            bool exact = true;
+            for ( size_t f = 0; f < sizeof(update_fields) / sizeof(update_fields[0]); f++ )
+            {
+                exact &= 0 == memcmp(update_fields[f][0], update_fields[f][1], n_bodies * sizeof(float));
+            }
+            if ( !exact )
+            {
+                fprintf(stderr, "verify: %s update differs from scalar\n", simd.name);
+                ok = false;
+            }
+
+            scalar.solve_constraint(expected, 3, n_bodies);
+            simd.solve_constraint(actual, 3, n_bodies);
+
+            const float* constraint_fields[][2] =
+            {
+                { expected.position.x, actual.position.x },
+                { expected.position.y, actual.position.y },
+                { expected.velocity.x, actual.velocity.x },
+                { expected.velocity.y, actual.velocity.y },
+                { expected.speed, actual.speed },
+                { expected.origin.x, actual.origin.x },
+                { expected.origin.y, actual.origin.y },
+            };
+            float worst = 0.0f;
+            for ( size_t f = 0; f < sizeof(constraint_fields) / sizeof(constraint_fields[0]); f++ )
+            {
+                float diff = max_difference(constraint_fields[f][0], constraint_fields[f][1], n_bodies);
+                if ( diff > worst || diff != diff ) worst = diff;
+            }
+            if ( !(worst <= tolerance) )
+            {
+                fprintf(stderr, "verify: %s solve_constraint off by %g (tolerance %g)\n", simd.name, worst, tolerance);
+                ok = false;
+            }
+
+            /* on the same store, since solve_constraint is not exact; neighbors
+               a few bodies apart, some touching, plus one pair with coincident
+               centers */
+            const size_t n_pairs = 517;
+            std::vector<CollisionPair> expected_pairs(n_pairs);
+            std::vector<uint8_t> expected_hit(n_pairs);
+            for ( size_t i = 0; i < n_pairs; i++ )
+            {
+                expected_pairs[i].bodyA = (uint32_t)((i * 7) % (n_bodies - 4));
+                expected_pairs[i].bodyB = expected_pairs[i].bodyA + 1 + (uint32_t)(i % 3);
+            }
+            for ( size_t i = 0; i < n_pairs; i += 2 )
+            {
+                Vector3 near = expected.origin.get(expected_pairs[i].bodyA);
+                near.x += (i % 11) * 0.05f;
+                near.y -= (i % 5) * 0.05f;
+                expected.origin.set(expected_pairs[i].bodyB, near);
+            }
+            expected.origin.set(expected_pairs[3].bodyB, expected.origin.get(expected_pairs[3].bodyA));
+
+            std::vector<CollisionPair> actual_pairs(expected_pairs);
+            std::vector<uint8_t> actual_hit(n_pairs);
+
+            scalar.narrowphase(expected, expected_pairs.data(), 3, n_pairs, expected_hit.data());
+            simd.narrowphase(expected, actual_pairs.data(), 3, n_pairs, actual_hit.data());
+
+            bool contacts_exact = 0 == memcmp(&expected_hit[3], &actual_hit[3], n_pairs - 3);
+            for ( size_t i = 3; i < n_pairs; i++ )
+            {
+                contacts_exact &= 0 == memcmp(&expected_pairs[i].collision, &actual_pairs[i].collision, sizeof(Collision));
+            }
+            if ( !contacts_exact )
+            {
+                fprintf(stderr, "verify: %s narrowphase differs from scalar\n", simd.name);
+                ok = false;
+            }
+
+            float swing_worst = 0.0f;
+            for ( int method = SwingIntegrator::Leapfrog; method < SwingIntegrator::Exact; method++ )
+            {
+                expected.assign(reference.bodies);
+                actual.assign(reference.bodies);
+
+                scalar.swing(expected, 3, n_bodies, g_fixedDeltaTime, 1.0f, SwingIntegrator::Enum(method));
+                simd.swing(actual, 3, n_bodies, g_fixedDeltaTime, 1.0f, SwingIntegrator::Enum(method));
+
+                const float* swing_fields[][2] =
+                {
+                    { expected.angle, actual.angle },
+                    { expected.lastAngle, actual.lastAngle },
+                    { expected.angularVelocity, actual.angularVelocity },
+                    { expected.lastPosition.x, actual.lastPosition.x },
+                };
+                for ( size_t f = 0; f < sizeof(swing_fields) / sizeof(swing_fields[0]); f++ )
+                {
+                    float diff = max_difference(swing_fields[f][0], swing_fields[f][1], n_bodies);
+                    if ( diff > swing_worst || diff != diff ) swing_worst = diff;
+                }
+            }
+            if ( !(swing_worst <= tolerance) )
+            {
+                fprintf(stderr, "verify: %s swing off by %g (tolerance %g)\n", simd.name, swing_worst, tolerance);
+                ok = false;
+            }
+
+            std::vector<Matrix4> expected_worlds(n_bodies);
+            std::vector<Matrix4> actual_worlds(n_bodies);
+            Vector3 offset = vector3::vector3(-2.5f, 0.25f, 0.0f);
+
+            scalar.transforms(reference.bodies.pose(), 3, n_bodies, 0.375f, offset, expected_worlds.data());
+            simd.transforms(reference.bodies.pose(), 3, n_bodies, 0.375f, offset, actual_worlds.data());
+
+            float transform_worst = max_difference((const float*)&expected_worlds[3], (const float*)&actual_worlds[3], (n_bodies - 3) * 16);
+            if ( !(transform_worst <= tolerance) )
+            {
+                fprintf(stderr, "verify: %s transforms off by %g (tolerance %g)\n", simd.name, transform_worst, tolerance);
+                ok = false;
+            }
+
+            printf("verify: %-6s update %s, narrowphase %s, solve_constraint max error %g, swing max error %g, transforms max error %g\n",
+                    simd.name, exact ? "exact" : "DIFFERS", contacts_exact ? "exact" : "DIFFERS", worst, swing_worst, transform_worst);
+        }
+
+        reference.step(g_fixedDeltaTime, 1.0f);
+    }
+
+    return ok;
+}
+
+/**
+ * Step a swinging cradle until it is warm and count what the rest of the
+ * steps allocate
+ * Fast bodies come and go as the cradle swings, so sweeps can first need
+ * scratch long after warmup; the arena must already have room.
+ * @param late_sweeps keep continuous collision off until warm
+ */
+static bool verify_allocations(bool late_sweeps)
+{
+    Simulation simulation;
+    simulation.create_bodies(2000);
+    simulation.set_starting_angles(45.0f, 40, 0);
+    simulation.continuousCollision = !late_sweeps;
+
+    for ( size_t step = 0; step < c_warmupSteps; step++ )
+    {
+        simulation.step(g_fixedDeltaTime, 1.0f);
+    }
+
+    size_t allocations = s_allocations.load();
+    simulation.continuousCollision = true;
+    for ( size_t step = c_warmupSteps; step < 2000; step++ )
+    {
+        simulation.step(g_fixedDeltaTime, 1.0f);
+    }
+    allocations = s_allocations.load() - allocations;
+
+    const char* sweeps = late_sweeps ? "turned on after step 100" : "on throughout";
+    printf("verify: %zu allocations after step %zu with continuous collision %s, %llu swept impacts\n",
+            allocations, c_warmupSteps, sweeps, (unsigned long long)simulation.sweptImpacts);
+    if ( 0 != allocations )
+    {
+        fprintf(stderr, "verify: stepping allocated %zu times with continuous collision %s\n", allocations, sweeps);
+        return false;
+    }
+    return true;
+}
+
+/** Re-simulate the log at @a path, returns false if it cannot be read or does not match. */
+static bool replay_run(JobSystem& jobs, const char* path)
+{
+    ReplayLog log;
+    if ( !log.load(path) )
+    {
+        fprintf(stderr, "cradle_sim: cannot read replay '%s'\n", path);
+        return false;
+    }
+
+    Simulation simulation;
+    simulation.jobs = &jobs;
+
+    typedef std::chrono::high_resolution_clock Clock;
+    Clock::time_point start = Clock::now();
+
+    bool ok = simulation.play(log);
+
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    printf("replay:         %s (%zu bytes)\n", path, log.data.size());
+    printf("kernels:        %s\n", kernels::active().name);
+    printf("balls:          %zu\n", simulation.bodies.count);
+    printf("wall time:      %.6f s\n", seconds);
+    printf("state hash:     %016llx\n", (unsigned long long)body_store::state_hash(simulation.bodies));
+    printf("result:         %s\n", ok ? "match" : "MISMATCH");
+
+    return ok;
+}
+
+/** Apply the settings of @a options to @a simulation. */
+static void configure(Simulation& simulation, const SimOptions& options)
+{
+    simulation.contactOrder = options.contact_order;
+    simulation.broadphaseType = options.broadphase;
+    simulation.warmStarting = !options.cold_start;
+    simulation.allowSleeping = !options.no_sleep;
+    simulation.continuousCollision = !options.no_ccd;
+    simulation.engine = options.engine;
+    simulation.integrator = options.integrator;
+    simulation.cradleSize = options.cradle_size;
+}
+
+/**
+ * Read the cradles of an ensemble from @a path
+ * One cradle per line, as "balls mass radius length degrees left right",
+ * optionally followed by how many copies of it to run. Blank lines and
+ * lines starting with # are skipped.
+ */
+static bool load_specs(const char* path, std::vector<CradleSpec>& specs)
+{
+    FILE* file = fopen(path, "r");
+    if ( NULL == file )
+    {
+        fprintf(stderr, "cradle_sim: cannot read ensemble '%s'\n", path);
+        return false;
+    }
+
+    char line[256];
+    size_t line_number = 0;
+    bool ok = true;
+    while ( ok && NULL != fgets(line, sizeof(line), file) )
+    {
+        line_number++;
+
+        const char* text = line;
+        while ( ' ' == *text || '\t' == *text ) text++;
+        if ( '#' == *text || '\n' == *text || '\r' == *text || '\0' == *text ) continue;
+
+        CradleSpec spec;
+        unsigned balls, left, right, copies = 1;
+        int fields = sscanf(text, "%u %f %f %f %f %u %u %u",
+                            &balls, &spec.mass, &spec.radius, &spec.length, &spec.degrees,
+                            &left, &right, &copies);
+
+        if ( fields < 7 || 0 == balls || !(spec.mass > 0) || !(spec.radius > 0) || !(spec.length > 0) )
+        {
+            fprintf(stderr, "cradle_sim: %s:%zu: expected balls mass radius length degrees left right [copies]\n",
+                    path, line_number);
+            ok = false;
+            break;
+        }
+
+        spec.balls = balls;
+        spec.left  = left;
+        spec.right = right;
+        specs.insert(specs.end(), copies, spec);
+    }
+
+    fclose(file);
+
+    if ( ok && specs.empty() )
+    {
+        fprintf(stderr, "cradle_sim: ensemble '%s' lists no cradles\n", path);
+        ok = false;
+    }
+    return ok;
+}
+
+/**
+ * Report the --check-alloc result, @a allocations made after the warmup
+ * Returns false if stepping allocated, or the run was too short to tell.
+ */
+static bool check_allocations(const SimOptions& options, size_t allocations)
+{
+    printf("allocations:    %zu after step %zu\n", allocations, c_warmupSteps);
+
+    if ( options.n_steps <= c_warmupSteps )
+    {
+        fprintf(stderr, "cradle_sim: --check-alloc needs more than %zu steps\n", c_warmupSteps);
+        return false;
+    }
+    if ( 0 != allocations )
+    {
+        fprintf(stderr, "cradle_sim: stepping allocated %zu times\n", allocations);
+        return false;
+    }
+    return true;
+}
+
+/** Step every cradle of options.ensemble_path together and report each one. */
+static bool ensemble_run(JobSystem& jobs, const SimOptions& options)
+{
+    Ensemble ensemble;
+    if ( !load_specs(options.ensemble_path, ensemble.specs) ) return false;
+
+    FILE* summary = stdout;
+    if ( NULL != options.summary_path )
+    {
+        summary = fopen(options.summary_path, "w");
+        if ( NULL == summary )
+        {
+            fprintf(stderr, "cradle_sim: cannot write summary '%s'\n", options.summary_path);
+            return false;
+        }
+    }
+
+    Simulation simulation;
+    simulation.jobs = &jobs;
+    configure(simulation, options);
+    simulation.cradleSize = 0;
+
+    ensemble.create(simulation, options.delta_time);
+
+    typedef std::chrono::high_resolution_clock Clock;
+    Clock::time_point start = Clock::now();
+
+    size_t allocations = 0;
+
+    for ( size_t step = 0; step < options.n_steps; step++ )
+    {
+        if ( c_warmupSteps == step ) allocations = s_allocations.load();
+
+        simulation.step(options.delta_time, 1.0f);
+        ensemble.sample(simulation, (uint32_t)(step + 1));
+    }
+
+    allocations = options.n_steps > c_warmupSteps ? s_allocations.load() - allocations : 0;
+    ensemble.finish(simulation, options.delta_time);
+
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    double steps_per_sec = seconds > 0.0 ? options.n_steps / seconds : 0.0;
+
+    size_t settled = 0;
+    for ( size_t c = 0; c < ensemble.stats.size(); c++ )
+    {
+        if ( 0 == ensemble.stats[c].awake ) settled++;
+    }
+
+    printf("kernels:        %s\n", kernels::active().name);
+    printf("threads:        %zu%s\n", jobs.thread_count(), jobs.deterministic ? " (deterministic)" : "");
+    printf("cradles:        %zu (%zu settled)\n", ensemble.specs.size(), settled);
+    printf("balls:          %zu\n", simulation.bodies.count);
+    printf("steps:          %zu\n", options.n_steps);
+    printf("wall time:      %.6f s\n", seconds);
+    printf("steps/sec:      %.1f\n", steps_per_sec);
+    printf("body-steps/sec: %.1f\n", steps_per_sec * simulation.bodies.count);
+    printf("state hash:     %016llx\n", (unsigned long long)body_store::state_hash(simulation.bodies));
+
+    fprintf(summary, "cradle,balls,mass,radius,length,degrees,left,right,"
+                     "start_energy,end_energy,energy_drift,peak_first,peak_last,transfer_step,awake\n");
+    for ( size_t c = 0; c < ensemble.specs.size(); c++ )
+    {
+        const CradleSpec& spec = ensemble.specs[c];
+        const CradleStats& s = ensemble.stats[c];
+        double drift = s.startEnergy > 0 ? (s.endEnergy - s.startEnergy) / s.startEnergy : 0.0;
+
+        fprintf(summary, "%zu,%u,%g,%g,%g,%g,%u,%u,%g,%g,%g,%g,%g,%u,%u\n",
+                c, spec.balls, spec.mass, spec.radius, spec.length, spec.degrees, spec.left, spec.right,
+                s.startEnergy, s.endEnergy, drift, s.peakFirst, s.peakLast, s.transferStep, s.awake);
+    }
+
+    bool ok = true;
+    if ( stdout != summary )
+    {
+        ok = 0 == fclose(summary);
+        if ( !ok ) fprintf(stderr, "cradle_sim: cannot write summary '%s'\n", options.summary_path);
+    }
+
+    /* cradles never touch, so equal specs must end equal */
+    size_t mismatched = ensemble.mismatched();
+    if ( mismatched > 0 )
+    {
+        fprintf(stderr, "cradle_sim: %zu cradles ended unlike the first cradle of their spec\n", mismatched);
+        ok = false;
+    }
+
+    if ( options.check_alloc && !check_allocations(options, allocations) )
+    {
+        ok = false;
+    }
+    return ok;
+}
+
+int main(int argc, char** argv)
+{
+    SimOptions options;
+    options.n_balls         = 5;
+    options.cradle_size     = 0;
+    options.n_steps         = 100000;
+    options.delta_time      = g_fixedDeltaTime;
+    options.starting_degree = 30.0f;
+    options.left_used       = 1;
+    options.right_used      = 0;
+    options.n_threads       = 1;
+    options.deterministic   = false;
+    options.contact_order   = ContactOrder::Islands;
+    options.broadphase      = BroadphaseType::SweepAndPrune;
+    options.verify_kernels  = false;
+    options.check_alloc     = false;
+    options.cold_start      = false;
+    options.contact_error   = false;
+    options.no_sleep        = false;
+    options.no_ccd          = false;
+    options.energy          = false;
+    options.engine          = StepEngine::Stepped;
+    options.integrator      = SwingIntegrator::Verlet;
+    options.record_path     = NULL;
+    options.replay_path     = NULL;
+    options.save_path       = NULL;
+    options.restore_path    = NULL;
+    options.trajectory_path = NULL;
+    options.ensemble_path   = NULL;
+    options.summary_path    = NULL;
+
+    if ( !parse_options(argc, argv, options) )
+    {
+        print_usage();
+        return EXIT_FAILURE;
+    }
+
+    if ( NULL != options.record_path && NULL != options.restore_path )
+    {
+        fprintf(stderr, "cradle_sim: a replay cannot start from a snapshot, drop --record or --restore\n");
+        return EXIT_FAILURE;
+    }
+
+    if ( NULL != options.ensemble_path && (NULL != options.record_path || NULL != options.restore_path
+                                        || NULL != options.save_path || NULL != options.trajectory_path) )
+    {
+        fprintf(stderr, "cradle_sim: --ensemble runs on its own, drop --record, --restore, --save and --trajectory\n");
+        return EXIT_FAILURE;
+    }
+
+    if ( options.verify_kernels )
+    {
+        bool ok = verify_kernels(1e-3f);
+        ok &= verify_allocations(false);
+        ok &= verify_allocations(true);
+        return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    JobSystem jobs;
+    jobs.init(options.n_threads, options.deterministic);
+
+    if ( NULL != options.replay_path )
+    {
+        return replay_run(jobs, options.replay_path) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    if ( NULL != options.ensemble_path )
+    {
+        return ensemble_run(jobs, options) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    ReplayLog log;
+
+    Simulation simulation;
+    simulation.jobs = &jobs;
+    if ( NULL != options.record_path ) simulation.replay = &log;
+    configure(simulation, options);
+
+    typedef std::chrono::high_resolution_clock Clock;
+
+    if ( NULL != options.restore_path )
+    {
+        Clock::time_point restore_start = Clock::now();
+        if ( !simulation.restore(options.restore_path) )
+        {
+            fprintf(stderr, "cradle_sim: cannot restore snapshot '%s'\n", options.restore_path);
+            return EXIT_FAILURE;
+        }
+        printf("restored:       %s in %.3f ms\n", options.restore_path,
+                std::chrono::duration<double, std::milli>(Clock::now() - restore_start).count());
+    }
+    else
+    {
+        simulation.create_bodies(options.n_balls);
+        simulation.set_starting_angles(options.starting_degree, options.left_used, options.right_used);
+    }
+
+    size_t n_balls = simulation.bodies.count;
+
+    TrajectoryRecorder trajectory;
+    if ( NULL != options.trajectory_path && !trajectory.open(options.trajectory_path, n_balls) )
+    {
+        fprintf(stderr, "cradle_sim: cannot write trajectory '%s'\n", options.trajectory_path);
+        return EXIT_FAILURE;
+    }
+    double start_energy = cradle_energy(simulation, options.delta_time);
+
+    Clock::time_point start = Clock::now();
+
+    size_t allocations = 0;
+    double error_sum = 0.0;
+    float error_max = 0.0f;
+    size_t error_step = 0;
+
+    for ( size_t step = 0; step < options.n_steps; step++ )
+    {
+        if ( c_warmupSteps == step ) allocations = s_allocations.load();
+
+        simulation.step(options.delta_time, 1.0f);
+        if ( NULL != options.trajectory_path ) trajectory.record(simulation.bodies, step + 1);
+
+        if ( options.contact_error )
+        {
+            float error = simulation.contact_error();
+            error_sum += error;
+            if ( error > error_max )
+            {
+                error_max = error;
+                error_step = step + 1;
+            }
+        }
+    }
+
+    allocations = options.n_steps > c_warmupSteps ? s_allocations.load() - allocations : 0;
+
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    double steps_per_sec = seconds > 0.0 ? options.n_steps / seconds : 0.0;
+
+    printf("kernels:        %s\n", kernels::active().name);
+    printf("threads:        %zu%s\n", jobs.thread_count(), jobs.deterministic ? " (deterministic)" : "");
+    printf("balls:          %zu\n", n_balls);
+    printf("steps:          %zu\n", options.n_steps);
+    printf("wall time:      %.6f s\n", seconds);
+    printf("steps/sec:      %.1f\n", steps_per_sec);
+    printf("body-steps/sec: %.1f\n", steps_per_sec * n_balls);
+    printf("awake:          %zu\n", simulation.awake_count());
+    printf("state hash:     %016llx\n", (unsigned long long)body_store::state_hash(simulation.bodies));
+
+    if ( NULL != options.record_path )
+    {
+        log.hash(body_store::state_hash(simulation.bodies));
+        if ( !log.save(options.record_path) )
+        {
+            fprintf(stderr, "cradle_sim: cannot write replay '%s'\n", options.record_path);
+            return EXIT_FAILURE;
+        }
+        printf("recorded:       %s (%zu bytes)\n", options.record_path, log.data.size());
+    }
+
+    if ( NULL != options.trajectory_path )
+    {
+        trajectory.close();
+
+        double raw = double(options.n_steps) * n_balls * g_trajectoryChannels * sizeof(float);
+        printf("trajectory:     %s, %llu bytes (%.1fx smaller than raw), %llu frames dropped\n",
+                options.trajectory_path, (unsigned long long)trajectory.bytes_written(),
+                trajectory.bytes_written() > 0 ? raw / trajectory.bytes_written() : 0.0,
+                (unsigned long long)trajectory.dropped_frames());
+    }
+
+    if ( NULL != options.save_path )
+    {
+        Clock::time_point save_start = Clock::now();
+        if ( !simulation.save(options.save_path) )
+        {
+            fprintf(stderr, "cradle_sim: cannot write snapshot '%s'\n", options.save_path);
+            return EXIT_FAILURE;
+        }
+        printf("saved:          %s in %.3f ms\n", options.save_path,
+                std::chrono::duration<double, std::milli>(Clock::now() - save_start).count());
+    }
+
+    if ( simulation.sweptImpacts > 0 )
+    {
+        printf("swept impacts:  %llu\n", (unsigned long long)simulation.sweptImpacts);
+    }
+
+    if ( StepEngine::Events == simulation.engine )
+    {
+        printf("impacts:        %llu\n", (unsigned long long)simulation.events.impacts);
+    }
+
+    if ( options.energy )
+    {
+        double end_energy = cradle_energy(simulation, options.delta_time);
+        printf("energy:         %g start, %g end, %+g relative drift\n",
+                start_energy, end_energy, start_energy > 0 ? (end_energy - start_energy) / start_energy : 0.0);
+    }
+
+    if ( options.contact_error )
+    {
+        printf("contact error:  %g mean, %g max at step %zu (%s start)\n",
+                options.n_steps > 0 ? error_sum / options.n_steps : 0.0, error_max, error_step,
+                simulation.warmStarting ? "warm" : "cold");
+    }
+
+    if ( options.check_alloc && !check_allocations(options, allocations) )
+    {
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,27 @@
+$input a_position, a_normal, i_data0, i_data1, i_data2, i_data3
+$output v_view, v_normal
+
+/*
+ * Copyright 2014 Dario Manesku. All rights reserved.
+ * License: http://www.opensource.org/licenses/BSD-2-Clause
+ */
+
+#include "../common/common.sh"
+
+uniform vec4 u_camPos;
+
+void main()
+{
+	mat4 model;
+	model[0] = i_data0;
+	model[1] = i_data1;
+	model[2] = i_data2;
+	model[3] = i_data3;
+
+	vec4 world = instMul(model, vec4(a_position, 1.0) );
+	gl_Position = mul(u_viewProj, world);
+
+	vec3 normal = a_normal * 2.0 - 1.0;
+	v_normal = instMul(model, vec4(normal, 0.0) ).xyz;
+	v_view = normalize(u_camPos.xyz - world.xyz);
+}